@@ -52,6 +52,8 @@
   -------------------------------------------------------------------------*/
 
 #include "neopixel.h"
+#include "neopixel_encode.h"
+#include <math.h>
 
 #if PLATFORM_ID == 0 // Core (0)
   #define pinLO(_pin) (PIN_MAP[_pin].gpio_peripheral->BRR = PIN_MAP[_pin].gpio_pin)
@@ -75,6 +77,41 @@
 #endif // SYSTEM_VERSION < SYSTEM_VERSION_ALPHA(5,0,0,2)
   #define pinLO(_pin) (nrf_gpio_pin_clear(NRF_GPIO_PIN_MAP(PIN_MAP2[_pin].gpio_port, PIN_MAP2[_pin].gpio_pin)))
   #define pinHI(_pin) (nrf_gpio_pin_set(NRF_GPIO_PIN_MAP(PIN_MAP2[_pin].gpio_port, PIN_MAP2[_pin].gpio_pin)))
+
+// [[[Begin of the Neopixel NRF52 EasyDMA implementation
+//                                    by the Hackerspace San Salvador]]]
+// This technique uses the PWM peripheral on the NRF52. The PWM uses the
+// EasyDMA feature included on the chip. This technique loads the duty 
+// cycle configuration for each cycle when the PWM is enabled. For this 
+// to work we need to store a 16 bit configuration for each bit of the
+// RGB(W) values in the pixel buffer.
+// Comparator values for the PWM were hand picked and are guaranteed to
+// be 100% organic to preserve freshness and high accuracy. Current 
+// parameters are:
+//   * PWM Clock: 16Mhz
+//   * Minimum step time: 62.5ns
+//   * Time for zero in high (T0H): 0.31ms
+//   * Time for one in high (T1H): 0.75ms
+//   * Cycle time:  1.25us
+//   * Frequency: 800Khz
+// ---------- BEGIN Constants for the EasyDMA implementation -----------
+// The PWM starts the duty cycle in LOW. To start with HIGH we
+// need to set the 15th bit on each register.
+
+// WS2812 (rev A) timing is 0.35 and 0.7us
+//#define MAGIC_T0H               5UL | (0x8000) // 0.3125us
+//#define MAGIC_T1H              12UL | (0x8000) // 0.75us
+
+// WS2812B (rev B) timing is 0.4 and 0.8 us
+#define MAGIC_T0H               6UL | (0x8000) // 0.375us
+#define MAGIC_T1H              13UL | (0x8000) // 0.8125us
+
+#define CTOPVAL                20UL            // 1.25us
+
+// ---------- END Constants for the EasyDMA implementation -------------
+
+// PWM instances begin() can reserve; one is claimed per strip.
+static NRF_PWM_Type* const pwmDevices[3] = {NRF_PWM0, NRF_PWM1, NRF_PWM2};
 #elif (PLATFORM_ID == 32) // HAL_PLATFORM_RTL872X
   // nothing extra needed for P2
 #else
@@ -83,30 +120,165 @@
 // fast pin access
 #define pinSet(_pin, _hilo) (_hilo ? pinHI(_pin) : pinLO(_pin))
 
+// Multiplier for brightness: (c * scale) >> 8.  See notes in setBrightness().
+static inline uint16_t brightnessScale(uint8_t brightness) {
+  return brightness ? brightness : 256;
+}
+
+#if NEOPIXEL_SPI_OUTPUT
+// Cell patterns for a neopixel '1' and '0' (see neopixel_encode.h).  WS2811
+// runs at half the SPI clock; on P2 the same cells scale correctly, on the
+// other platforms a shorter '1' keeps T1H in spec.
+#if (PLATFORM_ID == 32)
+typedef NeoPixelSpiCode<NEOPIXEL_SPI_BITS_PER_BIT, 0b110, 0b100> Ws2812SpiCode;
+typedef Ws2812SpiCode Ws2811SpiCode;
+#else
+typedef NeoPixelSpiCode<NEOPIXEL_SPI_BITS_PER_BIT, 0b1110, 0b1000> Ws2812SpiCode;
+typedef NeoPixelSpiCode<NEOPIXEL_SPI_BITS_PER_BIT, 0b1100, 0b1000> Ws2811SpiCode;
+#endif
+constexpr uint8_t numBitsPerBit = Ws2812SpiCode::BITS_PER_BIT; // How many SPI bits represent one neopixel bit
+
+static constexpr Ws2812SpiCode::Lut ws2812SpiLut = Ws2812SpiCode::makeLut();
+static_assert(Ws2812SpiCode::roundTrips(ws2812SpiLut), "SPI table does not decode back to the pixel bytes");
 #if (PLATFORM_ID == 32)
+static constexpr const Ws2811SpiCode::Lut &ws2811SpiLut = ws2812SpiLut;
+#else
+static constexpr Ws2811SpiCode::Lut ws2811SpiLut = Ws2811SpiCode::makeLut();
+static_assert(Ws2811SpiCode::roundTrips(ws2811SpiLut), "SPI table does not decode back to the pixel bytes");
+#endif
+
+// Keep the waveform inside what WS2812/WS2812B decode reliably in practice
+// (a little wider than the datasheet's +/-150ns)
+static_assert(Ws2812SpiCode::highNs(Ws2812SpiCode::CELL_LO, NEOPIXEL_SPI_CLOCK) >= 200 &&
+              Ws2812SpiCode::highNs(Ws2812SpiCode::CELL_LO, NEOPIXEL_SPI_CLOCK) <= 500, "T0H out of range");
+static_assert(Ws2812SpiCode::highNs(Ws2812SpiCode::CELL_HI, NEOPIXEL_SPI_CLOCK) >= 580, "T1H too short");
+static_assert(Ws2812SpiCode::bitNs(NEOPIXEL_SPI_CLOCK) >= 900 &&
+              Ws2812SpiCode::bitNs(NEOPIXEL_SPI_CLOCK) <= 1500, "bit period out of range");
+static_assert(Ws2811SpiCode::highNs(Ws2811SpiCode::CELL_LO, neoPixelSpiClock(WS2811)) >= 350 &&
+              Ws2811SpiCode::highNs(Ws2811SpiCode::CELL_LO, neoPixelSpiClock(WS2811)) <= 650, "WS2811 T0H out of range");
+static_assert(Ws2811SpiCode::highNs(Ws2811SpiCode::CELL_HI, neoPixelSpiClock(WS2811)) >= 1000 &&
+              Ws2811SpiCode::highNs(Ws2811SpiCode::CELL_HI, neoPixelSpiClock(WS2811)) <= 1350, "WS2811 T1H out of range");
+static_assert(Ws2811SpiCode::bitNs(neoPixelSpiClock(WS2811)) >= 1900, "WS2811 bit period too short");
+
+#ifdef HAL_PLATFORM_SPI_NUM
+  #define NEOPIXEL_SPI_INTERFACES HAL_PLATFORM_SPI_NUM
+#else
+  #define NEOPIXEL_SPI_INTERFACES 3 // SPI, SPI1 and (Electron) SPI2
+#endif
+
+// The SPI DMA completion callback runs in interrupt context and carries no
+// user argument, so each SPI interface gets its own busy flag, completion
+// time (the start of the latch) and callback.
+static_assert(NEOPIXEL_SPI_INTERFACES <= 3, "one DMA completion callback per SPI interface");
+static volatile bool spiTransferBusy[3];
+static volatile uint32_t spiTransferEnd[3];
+static void spiTransferDone0(void) { spiTransferEnd[0] = micros(); spiTransferBusy[0] = false; }
+static void spiTransferDone1(void) { spiTransferEnd[1] = micros(); spiTransferBusy[1] = false; }
+static void spiTransferDone2(void) { spiTransferEnd[2] = micros(); spiTransferBusy[2] = false; }
+// Strip whose frame was last started on each interface, so a second strip
+// sharing the bus waits for it instead of clobbering the transfer
+static Adafruit_NeoPixel *spiBusOwner[3];
+static const wiring_spi_dma_transfercomplete_callback_t spiTransferDone[] = {
+  spiTransferDone0, spiTransferDone1, spiTransferDone2
+};
+
 Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, SPIClass& spi, uint8_t t) :
-  begun(false), type(t), brightness(0), pixels(NULL), endTime(0)
+  begun(false), ownsPixels(false), fixedStorage(false), type(t), layout(neoPixelLayout(t)),
+  brightness(0), pixels(NULL), endTime(0),
+  dirtyFirst(0xFFFF), dirtyLast(0),
+  gammaExponent(1.0f), colorCorrection{255, 255, 255, 255}, lutStale(true), curveStale(true),
+  palette(NULL), paletteSpi(NULL), paletteMask(0), paletteStale(false),
+  powerBudget(0), powerScale(256), channelMilliamps(20), powerRescan(false), powerSum(0),
+  spiArray{NULL, NULL}, spiArraySize(0), spiBack(0), spiShowing(false),
+  ownsSpiArray(false), spiStaleFirst{0xFFFF, 0xFFFF}, spiStaleLast{0, 0},
+  ditherLut(NULL), ditherStep(0), ditherCursor{0, 0}, ditherPass{0, 0}
 {
+  spi_ = &spi;
   updateLength(n);
+}
+
+// Use caller-provided storage, see attachBuffer().
+Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, SPIClass& spi, uint8_t t,
+                                     uint8_t *pixelStorage, uint8_t *spiStorage,
+                                     bool clearPixels) :
+  begun(false), ownsPixels(false), fixedStorage(false), type(t), layout(neoPixelLayout(t)),
+  brightness(0), pixels(NULL), endTime(0),
+  dirtyFirst(0xFFFF), dirtyLast(0),
+  gammaExponent(1.0f), colorCorrection{255, 255, 255, 255}, lutStale(true), curveStale(true),
+  palette(NULL), paletteSpi(NULL), paletteMask(0), paletteStale(false),
+  powerBudget(0), powerScale(256), channelMilliamps(20), powerRescan(false), powerSum(0),
+  spiArray{NULL, NULL}, spiArraySize(0), spiBack(0), spiShowing(false),
+  ownsSpiArray(false), spiStaleFirst{0xFFFF, 0xFFFF}, spiStaleLast{0, 0},
+  ditherLut(NULL), ditherStep(0), ditherCursor{0, 0}, ditherPass{0, 0}
+{
   spi_ = &spi;
+  attachBuffer(n, pixelStorage, spiStorage, clearPixels);
 }
-#else
+#endif // NEOPIXEL_SPI_OUTPUT
+
+#if (PLATFORM_ID != 32)
 Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, uint8_t p, uint8_t t) :
-  begun(false), type(t), brightness(0), pixels(NULL), endTime(0)
+  begun(false), ownsPixels(false), fixedStorage(false), type(t), layout(neoPixelLayout(t)),
+  brightness(0), pixels(NULL), endTime(0),
+  dirtyFirst(0xFFFF), dirtyLast(0),
+  gammaExponent(1.0f), colorCorrection{255, 255, 255, 255}, lutStale(true), curveStale(true),
+  palette(NULL), paletteSpi(NULL), paletteMask(0), paletteStale(false),
+  powerBudget(0), powerScale(256), channelMilliamps(20), powerRescan(false), powerSum(0)
+#if HAL_PLATFORM_NRF52840
+  , pwmIndex(-1), pwmPattern(NULL)
+#elif NEOPIXEL_SPI_OUTPUT
+  , spi_(NULL), spiArray{NULL, NULL}, spiArraySize(0), spiBack(0), spiShowing(false),
+  ownsSpiArray(false), spiStaleFirst{0xFFFF, 0xFFFF}, spiStaleLast{0, 0},
+  ditherLut(NULL), ditherStep(0), ditherCursor{0, 0}, ditherPass{0, 0}
+#endif
 {
   updateLength(n);
   setPin(p);
 }
 
-#endif // #if (PLATFORM_ID == 32)
+// Use caller-provided storage, see attachBuffer().
+Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, uint8_t p, uint8_t t,
+                                     uint8_t *pixelStorage, bool clearPixels) :
+  begun(false), ownsPixels(false), fixedStorage(false), type(t), layout(neoPixelLayout(t)),
+  brightness(0), pixels(NULL), endTime(0),
+  dirtyFirst(0xFFFF), dirtyLast(0),
+  gammaExponent(1.0f), colorCorrection{255, 255, 255, 255}, lutStale(true), curveStale(true),
+  palette(NULL), paletteSpi(NULL), paletteMask(0), paletteStale(false),
+  powerBudget(0), powerScale(256), channelMilliamps(20), powerRescan(false), powerSum(0)
+#if HAL_PLATFORM_NRF52840
+  , pwmIndex(-1), pwmPattern(NULL)
+#elif NEOPIXEL_SPI_OUTPUT
+  , spi_(NULL), spiArray{NULL, NULL}, spiArraySize(0), spiBack(0), spiShowing(false),
+  ownsSpiArray(false), spiStaleFirst{0xFFFF, 0xFFFF}, spiStaleLast{0, 0},
+  ditherLut(NULL), ditherStep(0), ditherCursor{0, 0}, ditherPass{0, 0}
+#endif
+{
+  attachBuffer(n, pixelStorage, NULL, clearPixels);
+  setPin(p);
+}
+#endif // #if (PLATFORM_ID != 32)
 
 Adafruit_NeoPixel::~Adafruit_NeoPixel() {
-  if (pixels) free(pixels);
-#if (PLATFORM_ID == 32)
-  spi_->end();
-#else
-  if (begun) pinMode(pin, INPUT);
+  releaseStorage();
+#if NEOPIXEL_SPI_OUTPUT
+  if (spi_) {
+    if (spi_->interface() < NEOPIXEL_SPI_INTERFACES && spiBusOwner[spi_->interface()] == this) {
+      spiBusOwner[spi_->interface()] = NULL;
+    }
+    spi_->end();
+    free(ditherLut);
+    return;
+  }
 #endif
+#if HAL_PLATFORM_NRF52840
+  if (pwmIndex >= 0) pwmDevices[pwmIndex]->PSEL.OUT[0] = 0xFFFFFFFFUL; // release the PWM
+#endif
+  if (begun) pinMode(pin, INPUT);
+}
+
+// Mark the whole strip as changed since the last show()
+void Adafruit_NeoPixel::touchAll(void) {
+  if (numLEDs) touch(0, numLEDs - 1);
 }
 
 uint8_t Adafruit_NeoPixel::getPin() const {
@@ -117,23 +289,217 @@ uint8_t Adafruit_NeoPixel::getType() const {
     return type;
 }
 
+// Drop the palette and go back to full color pixels.  The caller frees or
+// replaces the (one byte per pixel) pixel buffer.
+void Adafruit_NeoPixel::releasePalette(void) {
+  free(palette);
+  free(paletteSpi);
+  palette = paletteSpi = NULL;
+  paletteMask = 0;
+}
+
+// Free the buffers this strip allocated itself and detach from any
+// caller-provided storage.  Palette mode ends here as well.
+void Adafruit_NeoPixel::releaseStorage(void) {
+#if NEOPIXEL_SPI_OUTPUT
+  waitShow(); // DMA may still be reading the front buffer
+  if (ownsSpiArray && spiArray[0]) free(spiArray[0]);
+  spiArray[0] = spiArray[1] = NULL;
+  spiArraySize = 0;
+  ownsSpiArray = false;
+#elif HAL_PLATFORM_NRF52840
+  free(pwmPattern);
+  pwmPattern = NULL;
+#endif
+  releasePalette();
+  if (ownsPixels && pixels) free(pixels);
+  pixels = NULL;
+  ownsPixels = false;
+  numLEDs = numBytes = 0;
+}
+
+// Take over 'pixelStorage' (and for SPI output the front/back SPI buffers in
+// 'spiStorage') for n pixels.  The pixels are cleared unless 'clearPixels'
+// is false.
+#if NEOPIXEL_SPI_OUTPUT
+void Adafruit_NeoPixel::attachStorage(uint16_t n, uint8_t *pixelStorage, uint8_t *spiStorage,
+                                      bool clearPixels) {
+#else
+void Adafruit_NeoPixel::attachStorage(uint16_t n, uint8_t *pixelStorage, bool clearPixels) {
+#endif
+  pixels = pixelStorage;
+  numBytes = n * layout.bytesPerPixel;
+  numLEDs = n;
+  if (clearPixels) memset(pixels, 0, numBytes);
+  powerSum = 0;
+  powerRescan = !clearPixels; // kept pixels are counted on the next show()
+
+#if NEOPIXEL_SPI_OUTPUT
+  // The tail byte of each SPI buffer is zeroed here and never written again.
+  if (spiStorage) {
+    uint32_t size = neoPixelSpiFrameSize(n, type);
+    memset(spiStorage, 0, size * 2);
+    spiArray[0] = spiStorage;
+    spiArray[1] = spiStorage + size;
+    spiArraySize = size;
+    spiBack = 0;
+  }
+#elif HAL_PLATFORM_NRF52840
+  if (pwmIndex >= 0) allocPwmPattern(); // already begun: resize the pattern
+#endif
+  touchAll(); // a fresh buffer has never been encoded
+}
+
+// Use caller-owned storage instead of the heap: a static array, retained
+// memory that survives a warm reset, or a buffer shared with a frame
+// decoder.  'pixelStorage' must hold n pixels (n * 3 bytes, 4 for RGBW).
+// SPI output strips also take 'spiStorage', neoPixelSpiBufferSize(n, type)
+// bytes; if it is NULL those buffers are allocated here.  The strip never
+// frees caller storage.  With 'clearPixels' false the buffer is kept as it
+// is and shown by the next show(), e.g. the frame from before a reset.
+// Anything the strip allocated before is freed, and palette mode ends.
+// Returns false (and the strip is left empty) on a NULL buffer or when the
+// SPI buffers can't be allocated.  A NeoPixelStrip keeps its own storage
+// and returns false without changing anything.
+bool Adafruit_NeoPixel::attachBuffer(uint16_t n, uint8_t *pixelStorage, uint8_t *spiStorage,
+                                     bool clearPixels) {
+  if (fixedStorage) {
+    Log.error("Strip storage is fixed at compile time");
+    return false;
+  }
+  releaseStorage();
+  if (n == 0 || !pixelStorage) return false;
+#if NEOPIXEL_SPI_OUTPUT
+  bool allocated = false;
+  if (spi_ && !spiStorage) {
+    spiStorage = (uint8_t *)malloc(neoPixelSpiBufferSize(n, type));
+    if (!spiStorage) {
+      Log.error("Not enough memory for %u pixel SPI buffer!", n);
+      return false;
+    }
+    allocated = true;
+  }
+  attachStorage(n, pixelStorage, spi_ ? spiStorage : NULL, clearPixels);
+  ownsSpiArray = allocated;
+#else
+  (void)spiStorage;
+  attachStorage(n, pixelStorage, clearPixels);
+#endif
+  return true;
+}
+
 void Adafruit_NeoPixel::updateLength(uint16_t n) {
-  if (pixels) free(pixels); // Free existing data (if any)
+  if (fixedStorage) {
+    Log.error("Strip storage is fixed at compile time");
+    return;
+  }
+  releaseStorage(); // Free existing data (if any)
+  if (n == 0) return;
 
   // Allocate new data -- note: ALL PIXELS ARE CLEARED
-  numBytes = n * ((type == SK6812RGBW) ? 4 : 3);
-  if ((pixels = (uint8_t *)malloc(numBytes))) {
-    memset(pixels, 0, numBytes);
-    numLEDs = n;
-  } else {
-    numLEDs = numBytes = 0;
+  uint8_t *pixelStorage = (uint8_t *)malloc(n * layout.bytesPerPixel);
+#if NEOPIXEL_SPI_OUTPUT
+  // The front and back SPI encode buffers are allocated once here and reused
+  // by every show(), so the frame path never touches the heap.  If they can't
+  // be allocated the strip is left empty (numPixels() == 0) and show() does
+  // nothing.
+  uint8_t *spiStorage = spi_ ? (uint8_t *)malloc(neoPixelSpiBufferSize(n, type)) : NULL;
+  if (!pixelStorage || (spi_ && !spiStorage)) {
+    if (spi_) Log.error("Not enough memory for %u pixel SPI buffer!", n);
+    free(pixelStorage);
+    free(spiStorage);
+    return;
   }
+  attachStorage(n, pixelStorage, spiStorage);
+  ownsSpiArray = (spiStorage != NULL);
+#else
+  if (!pixelStorage) return;
+  attachStorage(n, pixelStorage);
+#endif
+  ownsPixels = true;
 }
 
+#if HAL_PLATFORM_NRF52840
+// Claim a free PWM instance for this strip and configure it once.  The
+// claimed instance keeps the output pin selected (while disabled between
+// frames), so other code scanning for a free PWM sees it as taken.
+bool Adafruit_NeoPixel::reservePwm(void) {
+  for (int8_t device = 0; device < 3 && pwmIndex < 0; device++) {
+    NRF_PWM_Type* pwm = pwmDevices[device];
+    if ((pwm->ENABLE == 0)                            &&
+        (pwm->PSEL.OUT[0] & PWM_PSEL_OUT_CONNECT_Msk) &&
+        (pwm->PSEL.OUT[1] & PWM_PSEL_OUT_CONNECT_Msk) &&
+        (pwm->PSEL.OUT[2] & PWM_PSEL_OUT_CONNECT_Msk) &&
+        (pwm->PSEL.OUT[3] & PWM_PSEL_OUT_CONNECT_Msk)) {
+      pwmIndex = device;
+    }
+  }
+  if (pwmIndex < 0) {
+    Log.error("No free PWM instance for pixel output!");
+    return false;
+  }
+  NRF_PWM_Type* pwm = pwmDevices[pwmIndex];
+
+  // Set the wave mode to count UP
+  pwm->MODE = (PWM_MODE_UPDOWN_Up << PWM_MODE_UPDOWN_Pos);
+
+  // Set the PWM to use the 16MHz clock
+  pwm->PRESCALER = (PWM_PRESCALER_PRESCALER_DIV_1 << PWM_PRESCALER_PRESCALER_Pos);
+
+  // Setting of the maximum count
+  // but keeping it on 16Mhz allows for more granularity just
+  // in case someone wants to do more fine-tuning of the timing.
+  pwm->COUNTERTOP = (CTOPVAL << PWM_COUNTERTOP_COUNTERTOP_Pos);
+
+  // Disable loops, we want the sequence to repeat only once
+  pwm->LOOP = (PWM_LOOP_CNT_Disabled << PWM_LOOP_CNT_Pos);
+
+  // On the "Common" setting the PWM uses the same pattern for the
+  // for supported sequences. The pattern is stored on half-word
+  // of 16bits
+  pwm->DECODER = (PWM_DECODER_LOAD_Common << PWM_DECODER_LOAD_Pos) |
+                 (PWM_DECODER_MODE_RefreshCount << PWM_DECODER_MODE_Pos);
+
+  // The following settings are ignored with the current config.
+  pwm->SEQ[0].REFRESH  = 0;
+  pwm->SEQ[0].ENDDELAY = 0;
+
+  pwm->PSEL.OUT[0] = NRF_GPIO_PIN_MAP(PIN_MAP2[pin].gpio_port, PIN_MAP2[pin].gpio_pin);
+
+  return allocPwmPattern();
+}
+
+// (Re)allocate the EasyDMA pattern for the current length and point the
+// reserved PWM at it.  The pattern holds a 16 bit duty cycle for every bit
+// of the pixel buffer plus two to end the sequence:
+//              totalMem = numBytes*8*2+(2*2)
+bool Adafruit_NeoPixel::allocPwmPattern(void) {
+  free(pwmPattern);
+  pwmPattern = NULL;
+  if (!numBytes) return true;
+
+  uint32_t patternCount = numBytes * 8 + 2;
+  pwmPattern = (uint16_t *)malloc(patternCount * sizeof(uint16_t));
+  if (!pwmPattern) {
+    Log.error("Not enough memory for %u pixel PWM pattern!", numLEDs);
+    return false;
+  }
+  // Zero padding to indicate the end of the sequence
+  pwmPattern[patternCount - 2] = 0 | (0x8000); // Seq end
+  pwmPattern[patternCount - 1] = 0 | (0x8000); // Seq end
+
+  NRF_PWM_Type* pwm = pwmDevices[pwmIndex];
+  pwm->SEQ[0].PTR = (uint32_t)(pwmPattern) << PWM_SEQ_PTR_PTR_Pos;
+  pwm->SEQ[0].CNT = patternCount << PWM_SEQ_CNT_CNT_Pos;
+  touchAll(); // the new pattern has never been encoded
+  return true;
+}
+#endif // HAL_PLATFORM_NRF52840
+
 void Adafruit_NeoPixel::begin(void) {
 #if (PLATFORM_ID == 32)
-  if (getType() == WS2812B) {
-    if (spi_->interface() >= HAL_PLATFORM_SPI_NUM) {
+  if (neoPixelSpiSupports(type)) {
+    if (spi_->interface() >= NEOPIXEL_SPI_INTERFACES) {
       Log.error("SPI/SPI1 interface not defined!");
       return;
     }
@@ -158,7 +524,7 @@ void Adafruit_NeoPixel::begin(void) {
     spi_config.version = HAL_SPI_CONFIG_VERSION;
     spi_config.flags = (uint32_t)HAL_SPI_CONFIG_FLAG_MOSI_ONLY;
     hal_spi_begin_ext(spi_->interface(), SPI_MODE_MASTER, PIN_INVALID, &spi_config);
-    spi_->setClockSpeed(3125000); // DVOS 5.7.0 requires setClockSpeed() to be set after begin()
+    spi_->setClockSpeed(neoPixelSpiClock(type)); // DVOS 5.7.0 requires setClockSpeed() to be set after begin()
     // allow SCLK and MISO pin to be used as GPIO
     pinMode(sckPin, sckPinMode);
     pinMode(misoPin, misoPinMode);
@@ -170,8 +536,29 @@ void Adafruit_NeoPixel::begin(void) {
     }
   }
 #else
+#if NEOPIXEL_SPI_OUTPUT
+  if (spi_) {
+    if (neoPixelSpiSupports(type)) {
+      if (spi_->interface() >= NEOPIXEL_SPI_INTERFACES) {
+        Log.error("SPI interface not defined!");
+        return;
+      }
+      spi_->begin(PIN_INVALID); // PIN_INVALID will keep begin from taking over the default SS pin as OUTPUT
+      spi_->setBitOrder(MSBFIRST);
+      spi_->setDataMode(SPI_MODE0);
+      spi_->setClockSpeed(neoPixelSpiClock(type));
+    }
+    begun = true;
+    return;
+  }
+#endif
   pinMode(pin, OUTPUT);
   digitalWrite(pin, LOW);
+#if HAL_PLATFORM_NRF52840
+  // The PWM and its pattern buffer are set up here once rather than on
+  // every show(); without them show() does nothing.
+  if (pwmIndex < 0 && !reservePwm()) return;
+#endif
 #endif // #if (PLATFORM_ID == 32)
   begun = true;
 }
@@ -185,19 +572,17 @@ void Adafruit_NeoPixel::setPin(uint8_t p) {
     if (begun) {
         pinMode(p, OUTPUT);
         digitalWrite(p, LOW);
+#if HAL_PLATFORM_NRF52840
+        if (pwmIndex >= 0) {
+            pwmDevices[pwmIndex]->PSEL.OUT[0] = NRF_GPIO_PIN_MAP(PIN_MAP2[p].gpio_port, PIN_MAP2[p].gpio_pin);
+        }
+#endif
     }
 }
 
-void Adafruit_NeoPixel::show(void) {
-  if(!pixels) return;
-
-#if (PLATFORM_ID != 32)
-  // Data latch = 24 or 50 microsecond pause in the output stream.  Rather than
-  // put a delay at the end of the function, the ending time is noted and
-  // the function will simply hold off (if needed) on issuing the
-  // subsequent round of data until the latch time has elapsed.  This
-  // allows the mainline code to start generating the next frame of data
-  // rather than stalling for the latch.
+// Data latch = pause in the output stream the pixels need before they show
+// the data just sent, in microseconds.
+static uint32_t resetMicros(uint8_t type) {
   uint32_t wait_time; // wait time in microseconds.
   switch(type) {
     case TM1803: { // TM1803 = 24us reset pulse
@@ -220,6 +605,30 @@ void Adafruit_NeoPixel::show(void) {
         wait_time = 50L;
       } break;
   }
+  return wait_time;
+}
+
+void Adafruit_NeoPixel::show(void) {
+  if(!pixels) return;
+  if(powerBudget) updatePowerScale();
+  if(lutStale) updateOutputLut(); // before any timing-critical output
+
+#if NEOPIXEL_SPI_OUTPUT
+  if (spi_) {
+    showAsync(); // Encode and start the DMA transfer...
+    waitShow();  // ...then block until the frame is on the wire
+    return;
+  }
+#endif
+
+#if (PLATFORM_ID != 32)
+  // Data latch = 24 to 500 microsecond pause in the output stream.  Rather
+  // than put a delay at the end of the function, the ending time is noted and
+  // the function will simply hold off (if needed) on issuing the
+  // subsequent round of data until the latch time has elapsed.  This
+  // allows the mainline code to start generating the next frame of data
+  // rather than stalling for the latch.
+  uint32_t wait_time = resetMicros(type); // wait time in microseconds.
   while((micros() - endTime) < wait_time);
   // endTime is a private member (rather than global var) so that multiple
   // instances on different pins can be quickly issued in succession (each
@@ -227,6 +636,15 @@ void Adafruit_NeoPixel::show(void) {
 #endif // (PLATFORM_ID != 32)
 
 #if (PLATFORM_ID == 0) || (PLATFORM_ID == 6) || (PLATFORM_ID == 8) || (PLATFORM_ID == 10) || (PLATFORM_ID == 88) // Core (0), Photon (6), P1 (8), Electron (10) or Redbear Duo (88)
+  // Gamma, color correction and brightness are applied through the output
+  // tables as each pixel's bytes are loaded, which happens while the line is
+  // LOW between pixels, so bit timing is unaffected.
+  const uint8_t
+   *lutR = channelLut[0],
+   *lutG = channelLut[1],
+   *lutB = channelLut[2],
+   *lutW = channelLut[3];
+
   __disable_irq(); // Need 100% focus on instruction timing
 
   volatile uint32_t
@@ -245,9 +663,9 @@ void Adafruit_NeoPixel::show(void) {
     while(i) { // While bytes left... (3 bytes = 1 pixel)
       mask = 0x800000; // reset the mask
       i = i-3;      // decrement bytes remaining
-      g = *ptr++;   // Next green byte value
-      r = *ptr++;   // Next red byte value
-      b = *ptr++;   // Next blue byte value
+      g = lutG[*ptr++];   // Next green byte value
+      r = lutR[*ptr++];   // Next red byte value
+      b = lutB[*ptr++];   // Next blue byte value
       c = ((uint32_t)g << 16) | ((uint32_t)r <<  8) | b; // Pack the next 3 bytes to keep timing tight
       j = 0;        // reset the 24-bit counter
       do {
@@ -344,10 +762,10 @@ void Adafruit_NeoPixel::show(void) {
     while(i) { // While bytes left... (4 bytes = 1 pixel)
       mask = 0x80000000; // reset the mask
       i = i-4;      // decrement bytes remaining
-      r = *ptr++;   // Next red byte value
-      g = *ptr++;   // Next green byte value
-      b = *ptr++;   // Next blue byte value
-      w = *ptr++;   // Next white byte value
+      r = lutR[*ptr++];   // Next red byte value
+      g = lutG[*ptr++];   // Next green byte value
+      b = lutB[*ptr++];   // Next blue byte value
+      w = lutW[*ptr++];   // Next white byte value
       c = ((uint32_t)r << 24) | ((uint32_t)g << 16) | ((uint32_t)b <<  8) | w; // Pack the next 4 bytes to keep timing tight
       j = 0;        // reset the 32-bit counter
       do {
@@ -455,9 +873,9 @@ void Adafruit_NeoPixel::show(void) {
     while(i) { // While bytes left... (3 bytes = 1 pixel)
       mask = 0x800000; // reset the mask
       i = i-3;      // decrement bytes remaining
-      g = *ptr++;   // Next green byte value
-      r = *ptr++;   // Next red byte value
-      b = *ptr++;   // Next blue byte value
+      g = lutG[*ptr++];   // Next green byte value
+      r = lutR[*ptr++];   // Next red byte value
+      b = lutB[*ptr++];   // Next blue byte value
       c = ((uint32_t)g << 16) | ((uint32_t)r <<  8) | b; // Pack the next 3 bytes to keep timing tight
       j = 0;        // reset the 24-bit counter
       do {
@@ -484,9 +902,9 @@ void Adafruit_NeoPixel::show(void) {
     while(i) { // While bytes left... (3 bytes = 1 pixel)
       mask = 0x800000; // reset the mask
       i = i-3;      // decrement bytes remaining
-      r = *ptr++;   // Next red byte value
-      g = *ptr++;   // Next green byte value
-      b = *ptr++;   // Next blue byte value
+      r = lutR[*ptr++];   // Next red byte value
+      g = lutG[*ptr++];   // Next green byte value
+      b = lutB[*ptr++];   // Next blue byte value
       c = ((uint32_t)r << 16) | ((uint32_t)g <<  8) | b; // Pack the next 3 bytes to keep timing tight
       j = 0;        // reset the 24-bit counter
       do {
@@ -642,9 +1060,9 @@ void Adafruit_NeoPixel::show(void) {
     while(i) { // While bytes left... (3 bytes = 1 pixel)
       mask = 0x800000; // reset the mask
       i = i-3;      // decrement bytes remaining
-      r = *ptr++;   // Next red byte value
-      g = *ptr++;   // Next blue byte value
-      b = *ptr++;   // Next green byte value
+      r = lutR[*ptr++];   // Next red byte value
+      g = lutG[*ptr++];   // Next blue byte value
+      b = lutB[*ptr++];   // Next green byte value
       c = ((uint32_t)r << 16) | ((uint32_t)g <<  8) | b; // Pack the next 3 bytes to keep timing tight
       j = 0;        // reset the 24-bit counter
       do {
@@ -779,9 +1197,9 @@ void Adafruit_NeoPixel::show(void) {
     while(i) { // While bytes left... (3 bytes = 1 pixel)
       mask = 0x800000; // reset the mask
       i = i-3;      // decrement bytes remaining
-      r = *ptr++;   // Next red byte value
-      b = *ptr++;   // Next blue byte value
-      g = *ptr++;   // Next green byte value
+      r = lutR[*ptr++];   // Next red byte value
+      b = lutB[*ptr++];   // Next blue byte value
+      g = lutG[*ptr++];   // Next green byte value
       c = ((uint32_t)r << 16) | ((uint32_t)b <<  8) | g; // Pack the next 3 bytes to keep timing tight
       j = 0;        // reset the 24-bit counter
       pinSet(pin, LOW); // LOW
@@ -872,466 +1290,425 @@ void Adafruit_NeoPixel::show(void) {
 
   __enable_irq();
 
-#elif (PLATFORM_ID == 32)
-  if (getType() != WS2812B) { // WS2812 WS2812B and WS2813 supported for P2
-    Log.error("Pixel type not supported!");
-    return;
+#elif HAL_PLATFORM_NRF52840 // Argon, Boron, Xenon, B SoM, B5 SoM, E SoM X, Tracker
+  // The PWM instance and the pattern buffer were set up in begin(), so a
+  // frame is just re-encoding what changed and one EasyDMA sequence.  No
+  // interrupts are disabled, so the SoftDevice/radio keeps running.
+  if(pwmIndex < 0 || !pwmPattern) return; // begin() has already reported why
+  NRF_PWM_Type* pwm = pwmDevices[pwmIndex];
+
+  // The pattern holds one 16-bit duty cycle per bit and keeps the previous
+  // frame, so only the pixels changed since then are re-encoded.
+  if(dirtyFirst <= dirtyLast) {
+    uint16_t first = dirtyFirst * layout.bytesPerPixel;
+    uint16_t last = (dirtyLast + 1) * layout.bytesPerPixel;
+    uint16_t *pos = &pwmPattern[first * 8];
+    uint8_t k = 0; // byte within the current pixel
+
+    for(uint16_t n=first; n<last; n++) {
+      uint8_t pix = byteLut[k][pixels[n]];
+      if(++k == layout.bytesPerPixel) k = 0;
+
+      for(uint8_t mask=0x80; mask>0; mask >>= 1) {
+        *pos++ = (pix & mask) ? MAGIC_T1H : MAGIC_T0H;
+      }
+    }
   }
 
-  constexpr uint8_t PIX_HI = 0b110;
-  constexpr uint8_t PIX_LO = 0b100;
+  // Enable the PWM and start the sequence...
+  pwm->ENABLE = 1;
+  pwm->EVENTS_SEQEND[0]  = 0;
+  pwm->TASKS_SEQSTART[0] = 1;
 
-  uint16_t resetOff = 120; // 300us / (1/3125000Mhz) / 8bits_per_byte
-  switch (type) {
-    case WS2812B: { // WS2812, WS2812B & WS2813 = 300us reset pulse
-        resetOff = 120;
-      } break;
-    case WS2812B_FAST: // WS2812B_FAST = 50us reset pulse
-    default: {   // default = 50us reset pulse
-        resetOff = 20;
-      } break;
-  }
+  // ...and wait for the flag to be set.
+  while(!pwm->EVENTS_SEQEND[0]);
+
+  // Before leave we clear the flag for the event and hand the pin back to
+  // GPIO (which holds it LOW) until the next frame.
+  pwm->EVENTS_SEQEND[0] = 0;
+  pwm->ENABLE = 0;
+// END of NRF52 implementation
 
-  constexpr uint8_t numBitsPerBit = 3; // How many SPI bits represent one neopixel bit
-  uint32_t spiArraySize = (numBytes * numBitsPerBit) + resetOff + resetOff;
-  uint8_t* spiArray = NULL;
-  spiArray = (uint8_t*) malloc(spiArraySize);
 
-  if (spiArray == NULL) {
-    Log.error("Not enough memory available!");
+#endif
+  endTime = micros(); // Save EOD time for latch on next call
+  dirtyFirst = 0xFFFF; // Everything in 'pixels' is now on the strip
+  dirtyLast = 0;
+}
+
+#if NEOPIXEL_SPI_OUTPUT
+// Encode the pixel data into the back SPI buffer and hand it to the SPI DMA.
+// Returns as soon as the transfer has started, so the caller can render the
+// next frame while this one is clocked out.  A previous frame still in flight
+// is only waited on after the new one has been encoded.  A bit-banged strip
+// just shows synchronously.
+//
+// showAsync(), isShowing() and waitShow() keep unlocked per-strip state, so
+// call them (and show()) from the one thread that owns the strip.
+void Adafruit_NeoPixel::showAsync(void) {
+  if(!pixels) return;
+  if(!spi_) {
+    show();
     return;
   }
 
-  memset(spiArray, 0, spiArraySize);
-  // expand pixel data and pack into spi buffer
-  for (int x = 0; x < numPixels(); x++) {
-    for (int s = 0; s < 3; s++) {
-      spiArray[(x*9)+(s*3)+0+resetOff] = ((0x80 & pixels[(x*3)+s])?(PIX_HI << 5):(PIX_LO << 5)) + ((0x40 & pixels[(x*3)+s])?(PIX_HI << 2):(PIX_LO << 2)) + ((0x20 & pixels[(x*3)+s])?(0b11):(0b10));
-      spiArray[(x*9)+(s*3)+1+resetOff] = 0 /* bit 7 always 0 */ + ((0x10 & pixels[(x*3)+s])?(PIX_HI << 4):(PIX_LO << 4)) + ((0x08 & pixels[(x*3)+s])?(PIX_HI << 1):(PIX_LO << 1)) + 1 /* bit 0 always 1 */;
-      spiArray[(x*9)+(s*3)+2+resetOff] = ((0x04 & pixels[(x*3)+s])?(0b10 << 6):(0b00 << 6)) + ((0x02 & pixels[(x*3)+s])?(PIX_HI << 3):(PIX_LO << 3)) + ((0x01 & pixels[(x*3)+s])?(PIX_HI):(PIX_LO));
-    }
+  if (!neoPixelSpiSupports(type)) {
+    Log.error("Pixel type not supported!");
+    return;
   }
 
-  spi_->beginTransaction();
-  spi_->transfer(spiArray, nullptr, spiArraySize, nullptr);
-  spi_->endTransaction();
-
-  free(spiArray);
-
-#elif HAL_PLATFORM_NRF52840 // Argon, Boron, Xenon, B SoM, B5 SoM, E SoM X, Tracker
-// [[[Begin of the Neopixel NRF52 EasyDMA implementation
-//                                    by the Hackerspace San Salvador]]]
-// This technique uses the PWM peripheral on the NRF52. The PWM uses the
-// EasyDMA feature included on the chip. This technique loads the duty 
-// cycle configuration for each cycle when the PWM is enabled. For this 
-// to work we need to store a 16 bit configuration for each bit of the
-// RGB(W) values in the pixel buffer.
-// Comparator values for the PWM were hand picked and are guaranteed to
-// be 100% organic to preserve freshness and high accuracy. Current 
-// parameters are:
-//   * PWM Clock: 16Mhz
-//   * Minimum step time: 62.5ns
-//   * Time for zero in high (T0H): 0.31ms
-//   * Time for one in high (T1H): 0.75ms
-//   * Cycle time:  1.25us
-//   * Frequency: 800Khz
-// For 400Khz we just double the calculated times.
-// ---------- BEGIN Constants for the EasyDMA implementation -----------
-// The PWM starts the duty cycle in LOW. To start with HIGH we
-// need to set the 15th bit on each register.
-
-// WS2812 (rev A) timing is 0.35 and 0.7us
-//#define MAGIC_T0H               5UL | (0x8000) // 0.3125us
-//#define MAGIC_T1H              12UL | (0x8000) // 0.75us
-
-// WS2812B (rev B) timing is 0.4 and 0.8 us
-#define MAGIC_T0H               6UL | (0x8000) // 0.375us
-#define MAGIC_T1H              13UL | (0x8000) // 0.8125us
+  uint8_t spiIndex = spi_->interface();
+  if (spiIndex >= NEOPIXEL_SPI_INTERFACES) {
+    return; // begin() has already reported the bad interface
+  }
 
-// WS2811 (400 khz) timing is 0.5 and 1.2
-#define MAGIC_T0H_400KHz        8UL  | (0x8000) // 0.5us
-#define MAGIC_T1H_400KHz        19UL | (0x8000) // 1.1875us
+  if (powerBudget) updatePowerScale();
+  if (lutStale) updateOutputLut();
+  const Ws2812SpiCode::Lut &spiLut = (type == WS2811) ? ws2811SpiLut : ws2812SpiLut;
 
-// For 400Khz, we double value of CTOPVAL
-#define CTOPVAL                20UL            // 1.25us
-#define CTOPVAL_400KHz         40UL            // 2.5us
+  // In palette mode every entry is encoded once, through the same output
+  // tables as a full color pixel, and pixels are then a single copy each.
+  uint8_t paletteEntryBytes = layout.bytesPerPixel * numBitsPerBit;
+  if (palette && paletteStale) {
+    neoPixelSpiEncode(paletteSpi, palette, paletteMask + 1, layout.bytesPerPixel, byteLut, spiLut);
+    paletteStale = false;
+  }
 
-// ---------- END Constants for the EasyDMA implementation -------------
-// 
-// If there is no device available an alternative cycle-counter
-// implementation is tried.
-// The nRF52832 runs with a fixed clock of 64Mhz. The alternative
-// implementation is the same as the one used for the Teensy 3.0/1/2 but
-// with the Nordic SDK HAL & registers syntax.
-// The number of cycles was hand picked and is guaranteed to be 100% 
-// organic to preserve freshness and high accuracy.
-// ---------- BEGIN Constants for cycle counter implementation ---------
-#define CYCLES_800_T0H  18  // ~0.36 uS
-#define CYCLES_800_T1H  41  // ~0.76 uS
-#define CYCLES_800      71  // ~1.25 uS
-
-#define CYCLES_400_T0H  26  // ~0.50 uS
-#define CYCLES_400_T1H  70  // ~1.26 uS
-#define CYCLES_400      156 // ~2.50 uS
-// ---------- END of Constants for cycle counter implementation --------
-
-  // To support both the SoftDevice + Neopixels we use the EasyDMA
-  // feature from the NRF25. However this technique implies to
-  // generate a pattern and store it on the memory. The actual
-  // memory used in bytes corresponds to the following formula:
-  //              totalMem = numBytes*8*2+(2*2)
-  // The two additional bytes at the end are needed to reset the
-  // sequence.
-  //
-  // If there is not enough memory, we will fall back to cycle counter
-  // using DWT
-  uint32_t  pattern_size   = numBytes*8*sizeof(uint16_t)+2*sizeof(uint16_t);
-  uint16_t* pixels_pattern = NULL;
-
-  NRF_PWM_Type* pwm = NULL;
-
-  // Try to find a free PWM device, which is not enabled
-  // and has no connected pins
-  NRF_PWM_Type* PWM[3] = {NRF_PWM0, NRF_PWM1, NRF_PWM2};
-  for(int device = 0; device<3; device++) {
-    if( (PWM[device]->ENABLE == 0)                            &&
-        (PWM[device]->PSEL.OUT[0] & PWM_PSEL_OUT_CONNECT_Msk) &&
-        (PWM[device]->PSEL.OUT[1] & PWM_PSEL_OUT_CONNECT_Msk) &&
-        (PWM[device]->PSEL.OUT[2] & PWM_PSEL_OUT_CONNECT_Msk) &&
-        (PWM[device]->PSEL.OUT[3] & PWM_PSEL_OUT_CONNECT_Msk)
-    ) {
-      pwm = PWM[device];
-      break;
-    }
+  // Pixels changed since the last frame are stale in both SPI buffers.  Only
+  // the back buffer's stale range is re-encoded now; the front buffer keeps
+  // its range until it becomes the back buffer again.
+  for (uint8_t k = 0; k < 2; k++) {
+    if (dirtyFirst < spiStaleFirst[k]) spiStaleFirst[k] = dirtyFirst;
+    if (dirtyLast > spiStaleLast[k]) spiStaleLast[k] = dirtyLast;
   }
-  
-  // only malloc if there is PWM device available
-  if ( pwm != NULL ) {
-    #ifdef ARDUINO_FEATHER52 // use thread-safe malloc
-      pixels_pattern = (uint16_t *) rtos_malloc(pattern_size);
-    #else
-      pixels_pattern = (uint16_t *) malloc(pattern_size);
-    #endif
+  dirtyFirst = 0xFFFF;
+  dirtyLast = 0;
+
+  // Dither phase of the back buffer.  Each buffer keeps its own cursor and
+  // takes every other phase, so whatever the cap, the frames on the wire
+  // cycle through all the thresholds.
+  uint8_t ditherPhase = 2 * ditherPass[spiBack] + spiBack;
+
+  // When the dither pass below re-encodes every pixel, encoding the stale
+  // range first would only be overwritten.
+  bool ditherAll = ditherLut && !palette && (!ditherStep || ditherStep >= numLEDs);
+
+  if (ditherAll) {
+    spiStaleFirst[spiBack] = 0xFFFF;
+    spiStaleLast[spiBack] = 0;
+  } else if (spiStaleFirst[spiBack] <= spiStaleLast[spiBack]) {
+    uint16_t first = spiStaleFirst[spiBack];
+    uint16_t count = spiStaleLast[spiBack] - first + 1;
+    uint8_t *dst = &spiArray[spiBack][first * layout.bytesPerPixel * numBitsPerBit];
+
+    if (palette) {
+      neoPixelSpiEncodeIndexed(dst, &pixels[first], count, paletteSpi, paletteEntryBytes,
+                               paletteMask);
+    } else if (ditherLut) {
+      neoPixelSpiEncodeDithered(dst, &pixels[first * layout.bytesPerPixel], first, count,
+                                layout.bytesPerPixel, byteDitherLut, spiLut, ditherPhase);
+    } else {
+      // correct each byte through its channel's output table, then expand it
+      // and pack into the back spi buffer
+      neoPixelSpiEncode(dst, &pixels[first * layout.bytesPerPixel], count,
+                        layout.bytesPerPixel, byteLut, spiLut);
+    }
+    spiStaleFirst[spiBack] = 0xFFFF;
+    spiStaleLast[spiBack] = 0;
   }
 
-  // Use the identified device to choose the implementation
-  // If a PWM device is available use DMA
-  if( (pixels_pattern != NULL) && (pwm != NULL) ) {
-    uint16_t pos = 0; // bit position
-
-    for(uint16_t n=0; n<numBytes; n++) {
-      uint8_t pix = pixels[n];
-
-      for(uint8_t mask=0x80, i=0; mask>0; mask >>= 1, i++) {
-        #ifdef NEO_KHZ400
-        if( !is800KHz ) {
-          pixels_pattern[pos] = (pix & mask) ? MAGIC_T1H_400KHz : MAGIC_T0H_400KHz;
-        }else
-        #endif
-        {
-          pixels_pattern[pos] = (pix & mask) ? MAGIC_T1H : MAGIC_T0H;
-        }
-
-        pos++;
+  // Dithering: re-encode the next ditherStep pixels (all of them for 0)
+  // of the back buffer with its next phase, so their fractions are spread
+  // over frames even when nothing changed.  This is the only extra encode
+  // work dithering adds to a frame.
+  if (ditherLut && !palette && numLEDs) {
+    uint16_t &cursor = ditherCursor[spiBack];
+    uint16_t todo = (ditherStep && ditherStep < numLEDs) ? ditherStep : numLEDs;
+    while (todo) {
+      if (cursor >= numLEDs) { // also covers a strip that got shorter
+        cursor = 0;
+        ditherPass[spiBack]++;
       }
+      uint16_t count = numLEDs - cursor;
+      if (count > todo) count = todo;
+      neoPixelSpiEncodeDithered(&spiArray[spiBack][cursor * layout.bytesPerPixel * numBitsPerBit],
+                                &pixels[cursor * layout.bytesPerPixel], cursor, count,
+                                layout.bytesPerPixel, byteDitherLut, spiLut,
+                                2 * (ditherPass[spiBack] + 1) + spiBack);
+      cursor += count;
+      todo -= count;
     }
+  }
 
-    // Zero padding to indicate the end of que sequence
-    pixels_pattern[++pos] = 0 | (0x8000); // Seq end
-    pixels_pattern[++pos] = 0 | (0x8000); // Seq end
-
-    // Set the wave mode to count UP
-    pwm->MODE = (PWM_MODE_UPDOWN_Up << PWM_MODE_UPDOWN_Pos);
+  waitShow(); // only one frame on the wire at a time
+  Adafruit_NeoPixel *owner = spiBusOwner[spiIndex];
+  if (owner && owner != this) owner->waitShow(); // another strip on this bus
+  spiBusOwner[spiIndex] = this;
+
+  // The strip latches once the line has been LOW for the reset time.  That
+  // is counted from when the previous frame's DMA completed, however much
+  // later isShowing() noticed, so time spent rendering and encoding since
+  // then already counts toward it.
+  uint32_t waitTime = resetMicros(type);
+  while ((micros() - endTime) < waitTime);
+
+  spiTransferBusy[spiIndex] = true;
+  spiShowing = true;
+  // The bus lock is only held to start the transfer and is dropped again in
+  // this call, so it is never held between frames or across threads.  The
+  // DMA carries on by itself; strips sharing the interface wait for it above,
+  // and anything else sent on this MOSI would reach the pixels regardless.
+  spi_->beginTransaction();
+  spi_->transfer(spiArray[spiBack], nullptr, spiArraySize, spiTransferDone[spiIndex]);
+  spi_->endTransaction();
+  spiBack ^= 1; // the buffer in flight becomes the front buffer
+}
 
-    // Set the PWM to use the 16MHz clock
-    pwm->PRESCALER = (PWM_PRESCALER_PRESCALER_DIV_1 << PWM_PRESCALER_PRESCALER_Pos);
+// True while a frame started by showAsync() is still being clocked out.
+bool Adafruit_NeoPixel::isShowing(void) {
+  if (spiShowing && !spiTransferBusy[spi_->interface()]) {
+    spiShowing = false;
+    endTime = spiTransferEnd[spi_->interface()];
+  }
+  return spiShowing;
+}
 
-    // Setting of the maximum count
-    // but keeping it on 16Mhz allows for more granularity just
-    // in case someone wants to do more fine-tuning of the timing.
-#ifdef NEO_KHZ400
-    if( !is800KHz ) {
-      pwm->COUNTERTOP = (CTOPVAL_400KHz << PWM_COUNTERTOP_COUNTERTOP_Pos);
-    }else
-#endif
-    {
-      pwm->COUNTERTOP = (CTOPVAL << PWM_COUNTERTOP_COUNTERTOP_Pos);
-    }
+// Block until the frame started by showAsync() has been fully sent.
+void Adafruit_NeoPixel::waitShow(void) {
+  while (isShowing());
+}
+#else
+// The bit-banged and PWM outputs are synchronous; showAsync() just shows.
+void Adafruit_NeoPixel::showAsync(void) {
+  show();
+}
 
-    // Disable loops, we want the sequence to repeat only once
-    pwm->LOOP = (PWM_LOOP_CNT_Disabled << PWM_LOOP_CNT_Pos);
-
-    // On the "Common" setting the PWM uses the same pattern for the
-    // for supported sequences. The pattern is stored on half-word
-    // of 16bits
-    pwm->DECODER = (PWM_DECODER_LOAD_Common << PWM_DECODER_LOAD_Pos) |
-                   (PWM_DECODER_MODE_RefreshCount << PWM_DECODER_MODE_Pos);
-
-    // Pointer to the memory storing the patter
-    pwm->SEQ[0].PTR = (uint32_t)(pixels_pattern) << PWM_SEQ_PTR_PTR_Pos;
-
-    // Calculation of the number of steps loaded from memory.
-    pwm->SEQ[0].CNT = (pattern_size/sizeof(uint16_t)) << PWM_SEQ_CNT_CNT_Pos;
-
-    // The following settings are ignored with the current config.
-    pwm->SEQ[0].REFRESH  = 0;
-    pwm->SEQ[0].ENDDELAY = 0;
-
-    // The Neopixel implementation is a blocking algorithm. DMA
-    // allows for non-blocking operation. To "simulate" a blocking
-    // operation we enable the interruption for the end of sequence
-    // and block the execution thread until the event flag is set by
-    // the peripheral.
-//    pwm->INTEN |= (PWM_INTEN_SEQEND0_Enabled<<PWM_INTEN_SEQEND0_Pos);
-
-    // PSEL must be configured before enabling PWM
-    pwm->PSEL.OUT[0] = NRF_GPIO_PIN_MAP(PIN_MAP2[pin].gpio_port, PIN_MAP2[pin].gpio_pin);
-
-    // Enable the PWM
-    pwm->ENABLE = 1;
-
-    // After all of this and many hours of reading the documentation
-    // we are ready to start the sequence...
-    pwm->EVENTS_SEQEND[0]  = 0;
-    pwm->TASKS_SEQSTART[0] = 1;
-
-    // But we have to wait for the flag to be set.
-    while(!pwm->EVENTS_SEQEND[0])
-    {
-      #ifdef ARDUINO_FEATHER52
-      yield();
-      #endif
-    }
+bool Adafruit_NeoPixel::isShowing(void) {
+  return false;
+}
 
-    // Before leave we clear the flag for the event.
-    pwm->EVENTS_SEQEND[0] = 0;
-
-    // We need to disable the device and disconnect
-    // all the outputs before leave or the device will not
-    // be selected on the next call.
-    // TODO: Check if disabling the device causes performance issues.
-    pwm->ENABLE = 0;
-
-    pwm->PSEL.OUT[0] = 0xFFFFFFFFUL;
-
-    #ifdef ARDUINO_FEATHER52  // use thread-safe free
-      rtos_free(pixels_pattern);
-    #else
-      free(pixels_pattern);
-    #endif
-  }// End of DMA implementation
-  // ---------------------------------------------------------------------
-  else{
-    // Fall back to DWT
-    #ifdef ARDUINO_FEATHER52
-      // Bluefruit Feather 52 uses freeRTOS
-      // Critical Section is used since it does not block SoftDevice execution
-      taskENTER_CRITICAL();
-    #elif defined(NRF52_DISABLE_INT)
-      // If you are using the Bluetooth SoftDevice we advise you to not disable
-      // the interrupts. Disabling the interrupts even for short periods of time
-      // causes the SoftDevice to stop working.
-      // Disable the interrupts only in cases where you need high performance for
-      // the LEDs and if you are not using the EasyDMA feature.
-      __disable_irq();
-    #endif
-
-    uint32_t pinMask = 1UL << NRF_GPIO_PIN_MAP(PIN_MAP2[pin].gpio_port, PIN_MAP2[pin].gpio_pin);
-
-
-    uint32_t CYCLES_X00     = CYCLES_800;
-    uint32_t CYCLES_X00_T1H = CYCLES_800_T1H;
-    uint32_t CYCLES_X00_T0H = CYCLES_800_T0H;
-
-#ifdef NEO_KHZ400
-    if( !is800KHz )
-    {
-      CYCLES_X00     = CYCLES_400;
-      CYCLES_X00_T1H = CYCLES_400_T1H;
-      CYCLES_X00_T0H = CYCLES_400_T0H;
-    }
-#endif
+void Adafruit_NeoPixel::waitShow(void) {
+}
+#endif // NEOPIXEL_SPI_OUTPUT
 
-    // Enable DWT in debug core
-    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
-    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+// Set pixel color from separate R,G,B components:
+void Adafruit_NeoPixel::setPixelColor(
+  uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
+  if(n < numLEDs && !palette) {
+    if(type == TM1829 && r == 255) r = 254; // 255 on RED channel causes display to be in a special mode.
+    touch(n, n);
+    uint8_t *p = &pixels[n * layout.bytesPerPixel];
+    powerSub(p, layout.bytesPerPixel);
+    p[layout.r] = r;
+    p[layout.g] = g;
+    p[layout.b] = b;
+    powerAdd(p, layout.bytesPerPixel);
+  }
+}
 
-    // Tries to re-send the frame if is interrupted by the SoftDevice.
-    while(1) {
-      uint8_t *p = pixels;
+// Set pixel color from separate R,G,B,W components:
+void Adafruit_NeoPixel::setPixelColor(
+  uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
+  if(n < numLEDs && !palette) {
+    if(type == TM1829 && r == 255) r = 254; // 255 on RED channel causes display to be in a special mode.
+    touch(n, n);
+    uint8_t *p = &pixels[n * layout.bytesPerPixel];
+    powerSub(p, layout.bytesPerPixel);
+    p[layout.r] = r;
+    p[layout.g] = g;
+    p[layout.b] = b;
+    if(layout.bytesPerPixel == 4) p[layout.w] = w;
+    powerAdd(p, layout.bytesPerPixel);
+  }
+}
 
-      uint32_t cycStart = DWT->CYCCNT;
-      uint32_t cyc = 0;
+// Store packed WRGB color 'c' at 'p' in the strip's byte order.
+static inline void packColor(uint8_t *p, uint32_t c, const NeoPixelLayout &layout,
+                             uint8_t type) {
+  uint8_t
+    r = (uint8_t)(c >> 16),
+    g = (uint8_t)(c >>  8),
+    b = (uint8_t)c,
+    w = (uint8_t)(c >> 24);
+  if(type == TM1829 && r == 255) r = 254; // 255 on RED channel causes display to be in a special mode.
+  p[layout.r] = r;
+  p[layout.g] = g;
+  p[layout.b] = b;
+  if(layout.bytesPerPixel == 4) p[layout.w] = w;
+}
 
-      for(uint16_t n=0; n<numBytes; n++) {
-        uint8_t pix = *p++;
+// Set pixel color from 'packed' 32-bit RGB color:
+// If RGB+W color, order of bytes is WRGB in packed 32-bit form
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint32_t c) {
+  if(n < numLEDs && !palette) {
+    touch(n, n);
+    uint8_t *p = &pixels[n * layout.bytesPerPixel];
+    powerSub(p, layout.bytesPerPixel);
+    packColor(p, c, layout, type);
+    powerAdd(p, layout.bytesPerPixel);
+  }
+}
 
-        for(uint8_t mask = 0x80; mask; mask >>= 1) {
-          while(DWT->CYCCNT - cyc < CYCLES_X00);
-          cyc  = DWT->CYCCNT;
+// Set pixel color from hue, saturation and value; see ColorHSV().
+void Adafruit_NeoPixel::setPixelColorHSV(uint16_t n, uint16_t hue, uint8_t sat, uint8_t val) {
+  setPixelColor(n, ColorHSV(hue, sat, val));
+}
 
-          NRF_GPIO->OUTSET |= pinMask;
+// Set 'count' pixels starting at 'first' to packed color 'c'.  A count of 0
+// fills to the end of the strip.  The color is converted once and then
+// copied, so a whole-strip fill is a single pass over the buffer.
+void Adafruit_NeoPixel::fill(uint32_t c, uint16_t first, uint16_t count) {
+  if(first >= numLEDs || palette) return;
+  if(count == 0 || count > numLEDs - first) count = numLEDs - first;
+
+  uint8_t *p = &pixels[first * layout.bytesPerPixel];
+  uint16_t total = count * layout.bytesPerPixel;
+  powerSub(p, total);
+  packColor(p, c, layout, type);
+
+  // Double the filled region each pass until the span is covered
+  uint16_t done = layout.bytesPerPixel;
+  while(done < total) {
+    uint16_t chunk = (total - done < done) ? (total - done) : done;
+    memcpy(p + done, p, chunk);
+    done += chunk;
+  }
+  powerAdd(p, total);
+  touch(first, first + count - 1);
+}
 
-          if(pix & mask) {
-            while(DWT->CYCCNT - cyc < CYCLES_X00_T1H);
-          } else {
-            while(DWT->CYCCNT - cyc < CYCLES_X00_T0H);
-          }
+// Set 'count' pixels starting at 'first' from an array of packed colors.
+void Adafruit_NeoPixel::setPixels(uint16_t first, const uint32_t *colors, uint16_t count) {
+  if(first >= numLEDs || count == 0 || palette) return;
+  if(count > numLEDs - first) count = numLEDs - first;
 
-          NRF_GPIO->OUTCLR |= pinMask;
-        }
-      }
-      while(DWT->CYCCNT - cyc < CYCLES_X00);
+  uint8_t *p = &pixels[first * layout.bytesPerPixel];
+  powerSub(p, count * layout.bytesPerPixel);
+  for(uint16_t i = 0; i < count; i++) {
+    packColor(p, colors[i], layout, type);
+    p += layout.bytesPerPixel;
+  }
+  powerAdd(&pixels[first * layout.bytesPerPixel], count * layout.bytesPerPixel);
+  touch(first, first + count - 1);
+}
 
+// Copy 'len' bytes that are already in the strip's byte order (e.g. GRB for
+// WS2812B) into the buffer starting at pixel 'first'.  The bytes are stored
+// as-is with no color reordering; brightness is applied by show() as usual.
+// In palette mode the bytes are palette indexes, one per pixel.
+void Adafruit_NeoPixel::writeRaw(uint16_t first, const uint8_t *nativeBytes, uint16_t len) {
+  if(first >= numLEDs || len == 0) return;
+
+  uint8_t stride = palette ? 1 : layout.bytesPerPixel;
+  uint16_t offset = first * stride;
+  if(len > numBytes - offset) len = numBytes - offset;
+  if(palette) {
+    powerRescan = true; // indexes: recounted through the palette
+  } else {
+    powerSub(&pixels[offset], len);
+  }
+  memcpy(&pixels[offset], nativeBytes, len);
+  if(!palette) powerAdd(&pixels[offset], len);
+  touch(first, first + (len - 1) / stride);
+}
 
-      // If total time longer than 25%, resend the whole data.
-      // Since we are likely to be interrupted by SoftDevice
-      if ( (DWT->CYCCNT - cycStart) < ( 8*numBytes*((CYCLES_X00*5)/4) ) ) {
-        break;
-      }
+// Switch the strip to palette mode.  The pixel buffer is replaced by one
+// palette index per pixel (all cleared to index 0), which cuts the buffer
+// to a third or a quarter and lets show() copy each pixel's pre-encoded
+// SPI bytes instead of converting every color byte.  'count' colors
+// (packed WRGB) are loaded; the palette holds 16 entries for count <= 16,
+// otherwise 256, and unused entries are black.  Indexes are masked to the
+// palette size.  Calling it again replaces the colors but keeps the
+// indexes; updateLength() returns to full color.
+//
+// Only for SPI output strips that allocated their own pixel buffer.
+// Returns false (and leaves the strip unchanged) otherwise or when out of
+// memory.
+bool Adafruit_NeoPixel::setPalette(const uint32_t *colors, uint16_t count) {
+#if NEOPIXEL_SPI_OUTPUT
+  if(!spi_ || !ownsPixels || !numLEDs || count == 0 || count > 256) {
+    Log.error("Palette needs an SPI strip with its own pixel buffer and 1 to 256 colors");
+    return false;
+  }
 
-      // re-send need 300us delay
-      delayMicroseconds(300);
-    }
+  uint16_t size = (count <= 16) ? 16 : 256;
+  uint8_t *newPalette = (uint8_t *)calloc(size, layout.bytesPerPixel);
+  uint8_t *newPaletteSpi = (uint8_t *)malloc(size * layout.bytesPerPixel * numBitsPerBit);
+  uint8_t *indexes = palette ? pixels : (uint8_t *)malloc(numLEDs);
+  if(!newPalette || !newPaletteSpi || !indexes) {
+    Log.error("Not enough memory for %u color palette!", size);
+    free(newPalette);
+    free(newPaletteSpi);
+    if(indexes != pixels) free(indexes);
+    return false;
+  }
 
-    // Enable interrupts again
-    #ifdef ARDUINO_FEATHER52
-      taskEXIT_CRITICAL();
-    #elif defined(NRF52_DISABLE_INT)
-      __enable_irq();
-    #endif
+  if(!palette) {
+    memset(indexes, 0, numLEDs);
+    free(pixels);
+    pixels = indexes;
+    numBytes = numLEDs;
   }
-// END of NRF52 implementation
+  releasePalette();
+  palette = newPalette;
+  paletteSpi = newPaletteSpi;
+  paletteMask = size - 1;
+  for(uint16_t i = 0; i < count; i++) {
+    packColor(&palette[i * layout.bytesPerPixel], colors[i], layout, type);
+  }
+  paletteStale = true;
+  powerRescan = true;
+  touchAll();
+  return true;
+#else
+  (void)colors;
+  (void)count;
+  Log.error("Palette mode needs SPI output");
+  return false;
+#endif
+}
 
+// Change one palette color.  Every pixel using it changes on the next show().
+void Adafruit_NeoPixel::setPaletteColor(uint8_t i, uint32_t c) {
+  if(!palette || i > paletteMask) return;
+  packColor(&palette[i * layout.bytesPerPixel], c, layout, type);
+  paletteStale = true;
+  powerRescan = true;
+  touchAll();
+}
 
-#endif
-  endTime = micros(); // Save EOD time for latch on next call
+// Packed WRGB color of palette entry 'i', 0 if not in palette mode
+uint32_t Adafruit_NeoPixel::getPaletteColor(uint8_t i) const {
+  if(!palette || i > paletteMask) return 0;
+  const uint8_t *p = &palette[i * layout.bytesPerPixel];
+  uint32_t c = ((uint32_t)p[layout.r] << 16) | ((uint32_t)p[layout.g] <<  8) | (uint32_t)p[layout.b];
+  if(layout.bytesPerPixel == 4) c |= (uint32_t)p[layout.w] << 24;
+  return c;
 }
 
-// Set pixel color from separate R,G,B components:
-void Adafruit_NeoPixel::setPixelColor(
-  uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
-  if(n < numLEDs) {
-    if(brightness) { // See notes in setBrightness()
-      r = (r * brightness) >> 8;
-      g = (g * brightness) >> 8;
-      b = (b * brightness) >> 8;
-    }
-    uint8_t *p = &pixels[n * 3];
-    switch(type) {
-      case WS2812B: // WS2812, WS2812B & WS2813 is GRB order.
-      case WS2812B_FAST:
-      case WS2812B2:
-      case WS2812B2_FAST: {
-          *p++ = g;
-          *p++ = r;
-          *p = b;
-        } break;
-      case TM1829: { // TM1829 is special RBG order
-          if(r == 255) r = 254; // 255 on RED channel causes display to be in a special mode.
-          *p++ = r;
-          *p++ = b;
-          *p = g;
-        } break;
-      case WS2811: // WS2811 is RGB order
-      case TM1803: // TM1803 is RGB order
-      default: {   // default is RGB order
-          *p++ = r;
-          *p++ = g;
-          *p = b;
-        } break;
-    }
+// Set pixel 'n' to palette entry 'i' (palette mode only)
+void Adafruit_NeoPixel::setPixelIndex(uint16_t n, uint8_t i) {
+  if(n < numLEDs && palette) {
+    touch(n, n);
+    pixels[n] = i;
+    powerRescan = true;
   }
 }
 
-// Set pixel color from separate R,G,B,W components:
-void Adafruit_NeoPixel::setPixelColor(
-  uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
-  if(n < numLEDs) {
-    if(brightness) { // See notes in setBrightness()
-      r = (r * brightness) >> 8;
-      g = (g * brightness) >> 8;
-      b = (b * brightness) >> 8;
-      w = (w * brightness) >> 8;
-    }
-    uint8_t *p = &pixels[n * (type==SK6812RGBW?4:3)];
-    switch(type) {
-      case WS2812B: // WS2812, WS2812B & WS2813 is GRB order.
-      case WS2812B_FAST:
-      case WS2812B2:
-      case WS2812B2_FAST: {
-          *p++ = g;
-          *p++ = r;
-          *p = b;
-        } break;
-      case TM1829: { // TM1829 is special RBG order
-          if(r == 255) r = 254; // 255 on RED channel causes display to be in a special mode.
-          *p++ = r;
-          *p++ = b;
-          *p = g;
-        } break;
-      case SK6812RGBW: { // SK6812RGBW is RGBW order
-          *p++ = r;
-          *p++ = g;
-          *p++ = b;
-          *p = w;
-        } break;
-      case WS2811: // WS2811 is RGB order
-      case TM1803: // TM1803 is RGB order
-      default: {   // default is RGB order
-          *p++ = r;
-          *p++ = g;
-          *p = b;
-        } break;
-    }
-  }
+// Palette index of pixel 'n', 0 if not in palette mode
+uint8_t Adafruit_NeoPixel::getPixelIndex(uint16_t n) const {
+  if(n >= numLEDs || !palette) return 0;
+  return pixels[n] & paletteMask;
 }
 
-// Set pixel color from 'packed' 32-bit RGB color:
-// If RGB+W color, order of bytes is WRGB in packed 32-bit form
-void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint32_t c) {
-  if(n < numLEDs) {
-    uint8_t
-      r = (uint8_t)(c >> 16),
-      g = (uint8_t)(c >>  8),
-      b = (uint8_t)c;
-    if(brightness) { // See notes in setBrightness()
-      r = (r * brightness) >> 8;
-      g = (g * brightness) >> 8;
-      b = (b * brightness) >> 8;
-    }
-    uint8_t *p = &pixels[n * (type==SK6812RGBW?4:3)];
-    switch(type) {
-      case WS2812B: // WS2812, WS2812B & WS2813 is GRB order.
-      case WS2812B_FAST:
-      case WS2812B2:
-      case WS2812B2_FAST: {
-          *p++ = g;
-          *p++ = r;
-          *p = b;
-        } break;
-      case TM1829: { // TM1829 is special RBG order
-          if(r == 255) r = 254; // 255 on RED channel causes display to be in a special mode.
-          *p++ = r;
-          *p++ = b;
-          *p = g;
-        } break;
-      case SK6812RGBW: { // SK6812RGBW is RGBW order
-          uint8_t w = (uint8_t)(c >> 24);
-          *p++ = r;
-          *p++ = g;
-          *p++ = b;
-          *p = brightness ? ((w * brightness) >> 8) : w;
-        } break;
-      case WS2811: // WS2811 is RGB order
-      case TM1803: // TM1803 is RGB order
-      default: {   // default is RGB order
-          *p++ = r;
-          *p++ = g;
-          *p = b;
-        } break;
-    }
-  }
+// Set 'count' pixels starting at 'first' to palette entry 'i'.  A count of
+// 0 fills to the end of the strip.
+void Adafruit_NeoPixel::fillIndex(uint8_t i, uint16_t first, uint16_t count) {
+  if(first >= numLEDs || !palette) return;
+  if(count == 0 || count > numLEDs - first) count = numLEDs - first;
+  memset(&pixels[first], i, count);
+  powerRescan = true;
+  touch(first, first + count - 1);
 }
 
 void Adafruit_NeoPixel::setColor(uint16_t aLedNumber, byte aRed, byte aGreen, byte aBlue) {
@@ -1377,49 +1754,73 @@ uint32_t Adafruit_NeoPixel::Color(uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
   return ((uint32_t)w << 24) | ((uint32_t)r << 16) | ((uint32_t)g <<  8) | b;
 }
 
+// Convert hue, saturation and value into packed 32-bit RGB color, integer
+// math only.  'hue' goes once round the color wheel over 0-65535 (0 = red,
+// 21845 = green, 43690 = blue) so it can simply be incremented and allowed
+// to wrap.  'sat' 0 is white and 'val' 0 is black.  No gamma is applied
+// here; use setGamma() for that.
+uint32_t Adafruit_NeoPixel::ColorHSV(uint16_t hue, uint8_t sat, uint8_t val) {
+  uint8_t r, g, b;
+
+  // Remap 0-65535 to 0-1529: six 255-step ramps between the primaries and
+  // secondaries, so every step is one unit of red, green or blue.
+  hue = (hue * 1530L + 32768) / 65536;
+  if(hue < 510) {         // Red to Green-1
+    b = 0;
+    if(hue < 255) {       //   Red to Yellow-1
+      r = 255;
+      g = hue;
+    } else {              //   Yellow to Green-1
+      r = 510 - hue;
+      g = 255;
+    }
+  } else if(hue < 1020) { // Green to Blue-1
+    r = 0;
+    if(hue < 765) {       //   Green to Cyan-1
+      g = 255;
+      b = hue - 510;
+    } else {              //   Cyan to Blue-1
+      g = 1020 - hue;
+      b = 255;
+    }
+  } else if(hue < 1530) { // Blue to Red-1
+    g = 0;
+    if(hue < 1275) {      //   Blue to Magenta-1
+      r = hue - 1020;
+      b = 255;
+    } else {              //   Magenta to Red-1
+      r = 255;
+      b = 1530 - hue;
+    }
+  } else {                // Last 0.5 Red (quicker than % operator)
+    r = 255;
+    g = b = 0;
+  }
+
+  // Apply saturation and value: s1 and v1 are 1-256 so a shift replaces
+  // the divide, and s2 lifts every channel toward white as sat drops.
+  uint32_t v1 = 1 + val;
+  uint16_t s1 = 1 + sat;
+  uint8_t  s2 = 255 - sat;
+  return ((((((r * s1) >> 8) + s2) * v1) & 0xff00) << 8) |
+          (((((g * s1) >> 8) + s2) * v1) & 0xff00) |
+         ( ((((b * s1) >> 8) + s2) * v1) >> 8);
+}
+
 // Query color from previously-set pixel (returns packed 32-bit RGB value)
 uint32_t Adafruit_NeoPixel::getPixelColor(uint16_t n) const {
   if(n >= numLEDs) {
     // Out of bounds, return no color.
     return 0;
   }
+  if(palette) return getPaletteColor(pixels[n] & paletteMask);
 
-  uint8_t *p = &pixels[n * (type==SK6812RGBW?4:3)];
-  uint32_t c;
+  // RGBW strips return packed WRGB color
+  const uint8_t *p = &pixels[n * layout.bytesPerPixel];
+  uint32_t c = ((uint32_t)p[layout.r] << 16) | ((uint32_t)p[layout.g] <<  8) | (uint32_t)p[layout.b];
+  if(layout.bytesPerPixel == 4) c |= (uint32_t)p[layout.w] << 24;
 
-  switch(type) {
-    case WS2812B: // WS2812, WS2812B & WS2813 is GRB order.
-    case WS2812B_FAST:
-    case WS2812B2:
-    case WS2812B2_FAST: {
-        c = ((uint32_t)p[1] << 16) | ((uint32_t)p[0] <<  8) | (uint32_t)p[2];
-      } break;
-    case TM1829: { // TM1829 is special RBG order
-        c = ((uint32_t)p[0] << 16) | ((uint32_t)p[2] <<  8) | (uint32_t)p[1];
-      } break;
-    case SK6812RGBW: { // SK6812RGBW is RGBW order, but returns packed WRGB color
-        c = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] <<  8) | (uint32_t)p[3];
-      } break;
-    case WS2811: // WS2811 is RGB order
-    case TM1803: // TM1803 is RGB order
-    default: {   // default is RGB order
-        c = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] <<  8) | (uint32_t)p[2];
-      } break;
-  }
-
-  // Adjust this back up to the true color, as setting a pixel color will
-  // scale it back down again.
-  if(brightness) { // See notes in setBrightness()
-    //Cast the color to a byte array
-    uint8_t * c_ptr =reinterpret_cast<uint8_t*>(&c);
-    if (type == SK6812RGBW) {
-      c_ptr[3] = (c_ptr[3] << 8)/brightness;
-    }
-    c_ptr[0] = (c_ptr[0] << 8)/brightness;
-    c_ptr[1] = (c_ptr[1] << 8)/brightness;
-    c_ptr[2] = (c_ptr[2] << 8)/brightness;
-  }
-  return c; // Pixel # is out of bounds
+  return c;
 }
 
 uint8_t *Adafruit_NeoPixel::getPixels(void) const {
@@ -1436,16 +1837,10 @@ uint16_t Adafruit_NeoPixel::getNumLeds(void) const {
 
 // Adjust output brightness; 0=darkest (off), 255=brightest.  This does
 // NOT immediately affect what's currently displayed on the LEDs.  The
-// next call to show() will refresh the LEDs at this level.  However,
-// this process is potentially "lossy," especially when increasing
-// brightness.  The tight timing in the WS2811/WS2812 code means there
-// aren't enough free cycles to perform this scaling on the fly as data
-// is issued.  So we make a pass through the existing color data in RAM
-// and scale it (subsequent graphics commands also work at this
-// brightness level).  If there's a significant step up in brightness,
-// the limited number of steps (quantization) in the old data will be
-// quite visible in the re-scaled version.  For a non-destructive
-// change, you'll need to re-render the full strip data.  C'est la vie.
+// next call to show() will refresh the LEDs at this level.  The stored
+// pixel colors are never touched: brightness is applied as the data is
+// encoded for output, so changing it is O(1) and lossless, and
+// getPixelColor() always returns the color that was set.
 void Adafruit_NeoPixel::setBrightness(uint8_t b) {
   // Stored brightness value is different than what's passed.
   // This simplifies the actual scaling math later, allowing a fast
@@ -1455,22 +1850,222 @@ void Adafruit_NeoPixel::setBrightness(uint8_t b) {
   // brightness (off), 255 = just below max brightness.
   uint8_t newBrightness = b + 1;
   if(newBrightness != brightness) { // Compare against prior value
-    // Brightness has changed -- re-scale existing data in RAM
-    uint8_t  c,
-            *ptr           = pixels,
-             oldBrightness = brightness - 1; // De-wrap old brightness value
-    uint16_t scale;
-    if(oldBrightness == 0) scale = 0; // Avoid /0
-    else if(b == 255) scale = 65535 / oldBrightness;
-    else scale = (((uint16_t)newBrightness << 8) - 1) / oldBrightness;
-    for(uint16_t i=0; i<numBytes; i++) {
-      c      = *ptr;
-      *ptr++ = (c * scale) >> 8;
-    }
     brightness = newBrightness;
+    lutStale = true; // folded into the output tables on the next show()
+    touchAll();      // every encoded byte changes
   }
 }
 
+// Set the gamma exponent applied to every color byte on output:
+// out = 255 * (in / 255) ^ g.  1.0 (the default) is linear; around 2.2 to
+// 2.8 makes mixed colors look closer to what was asked for on WS2812s.
+// Like brightness, this never changes the stored pixel colors.
+void Adafruit_NeoPixel::setGamma(float g) {
+  if(g != gammaExponent) {
+    gammaExponent = g;
+    curveStale = true;
+    lutStale = true;
+    touchAll();
+  }
+}
+
+// Set per-channel white balance: each channel is scaled by (c + 1) / 256
+// on output.  255 for every channel (the default) means no correction.
+void Adafruit_NeoPixel::setColorCorrection(uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
+  uint8_t c[4] = { r, g, b, w };
+  if(memcmp(c, colorCorrection, sizeof(c))) {
+    memcpy(colorCorrection, c, sizeof(c));
+    lutStale = true;
+    touchAll();
+  }
+}
+
+float Adafruit_NeoPixel::getGamma(void) const {
+  return gammaExponent;
+}
+
+// Keep the estimated supply current within 'milliamps' (0 turns the limit
+// off).  The estimate is NEOPIXEL_IDLE_MILLIAMPS per pixel plus
+// 'channelMa' per color channel at full output (20 for WS2812B),
+// scaled by brightness.  Gamma and color correction only lower the real
+// current, so they are left out.  When a frame would go over budget,
+// show() dims the whole strip, through the same output tables as
+// brightness, so the limit costs nothing per byte.  The dimming moves in
+// steps of NEOPIXEL_POWER_SCALE_STEP/256, down as soon as a frame needs
+// it and back up only once the estimate has two steps to spare, so an
+// estimate hovering at the limit doesn't re-encode the strip every frame.
+//
+// Setting a budget counts the buffer once; after that the total is kept
+// up to date as pixels are written.  Writes through getPixels() plus
+// markDirty() and palette mode are recounted on the next show().
+void Adafruit_NeoPixel::setPowerBudget(uint16_t milliamps, uint8_t channelMa) {
+  powerBudget = milliamps;
+  channelMilliamps = channelMa;
+  powerRescan = true;
+  if(!milliamps && powerScale != 256) {
+    powerScale = 256;
+    lutStale = true;
+    touchAll();
+  }
+}
+
+// Temporal dithering for SPI output strips.  The output tables are kept
+// in 8.8 fixed point and every showAsync() rounds each byte with a
+// different threshold, so a level that falls between two output steps
+// (common at low brightness with gamma) is shown as a mix of both over 8
+// frames instead of being rounded to one of them.  Frames must be sent at
+// a steady, fast rate -- call showAsync() every frame whether or not
+// anything changed -- or the mix is seen as flicker.
+//
+// 'pixelsPerFrame' caps the extra encode work: each frame re-encodes that
+// many more pixels past the changed ones, round the strip (0 = all of
+// them).  Lower caps cost less per frame but move the dither more slowly.
+// Takes a 2 KB table while enabled.  Palette mode is not dithered.
+// Returns false if the strip has no SPI output or out of memory.
+bool Adafruit_NeoPixel::setDithering(bool enable, uint16_t pixelsPerFrame) {
+#if NEOPIXEL_SPI_OUTPUT
+  if(enable && !spi_) {
+    Log.error("Dithering needs SPI output");
+    return false;
+  }
+  ditherStep = pixelsPerFrame;
+  if(enable == (ditherLut != NULL)) return true;
+
+  if(enable) {
+    ditherLut = (uint16_t (*)[256])malloc(4 * 256 * sizeof(uint16_t));
+    if(!ditherLut) {
+      Log.error("Not enough memory for dithering!");
+      return false;
+    }
+  } else {
+    free(ditherLut);
+    ditherLut = NULL;
+  }
+  lutStale = true;
+  touchAll();
+  return true;
+#else
+  (void)pixelsPerFrame;
+  if(enable) Log.error("Dithering needs SPI output");
+  return !enable;
+#endif
+}
+
+// True while setPalette() has the pixel buffer holding one palette index
+// per pixel instead of colors
+bool Adafruit_NeoPixel::isPaletteMode(void) const {
+  return palette != NULL;
+}
+
+bool Adafruit_NeoPixel::isDithering(void) const {
+#if NEOPIXEL_SPI_OUTPUT
+  return ditherLut != NULL;
+#else
+  return false;
+#endif
+}
+
+// Estimated supply current in mA for the pixels and brightness as set,
+// before the budget is applied.  0 while no budget is set.
+uint32_t Adafruit_NeoPixel::getPowerEstimate(void) {
+  if(!powerBudget) return 0;
+  if(powerRescan) {
+    powerSum = 0;
+    if(palette) {
+      for(uint16_t n = 0; n < numLEDs; n++) {
+        const uint8_t *p = &palette[(pixels[n] & paletteMask) * layout.bytesPerPixel];
+        for(uint8_t k = 0; k < layout.bytesPerPixel; k++) powerSum += p[k];
+      }
+    } else {
+      for(uint16_t i = 0; i < numBytes; i++) powerSum += pixels[i];
+    }
+    powerRescan = false;
+  }
+  return (uint32_t)numLEDs * NEOPIXEL_IDLE_MILLIAMPS +
+         (((powerSum * channelMilliamps / 255) * brightnessScale(brightness)) >> 8);
+}
+
+// Pick the output scale that keeps this frame within the power budget, in
+// steps of NEOPIXEL_POWER_SCALE_STEP.  The scale drops to the step below
+// what the frame needs straight away, but only rises again once the frame
+// would fit two steps higher, so only a real change in load rebuilds the
+// tables and re-encodes the strip.
+void Adafruit_NeoPixel::updatePowerScale(void) {
+  uint32_t idle = (uint32_t)numLEDs * NEOPIXEL_IDLE_MILLIAMPS;
+  uint32_t estimate = getPowerEstimate();
+  uint32_t needed = 512; // anything over 256 fits at full output
+  if(estimate > idle) {
+    needed = (powerBudget > idle) ? (powerBudget - idle) * 256 / (estimate - idle) : 0;
+  }
+  if(needed < powerScale || needed >= (uint32_t)powerScale + 2 * NEOPIXEL_POWER_SCALE_STEP) {
+    uint16_t scale = (needed >= 256) ? 256 : needed - needed % NEOPIXEL_POWER_SCALE_STEP;
+    if(scale != powerScale) {
+      powerScale = scale;
+      lutStale = true;
+      touchAll();
+    }
+  }
+}
+
+// Rebuild the cached gamma curve.  It keeps 8 more bits than the output
+// tables so the dithered tables can be scaled from it before anything is
+// rounded away.  Only runs after setGamma(); the powf() calls stay off the
+// path brightness and the power budget take.
+void Adafruit_NeoPixel::updateGammaCurve(void) {
+  for(uint16_t v = 0; v < 256; v++) {
+    uint32_t c16 = (uint32_t)v << 8;
+    if(gammaExponent != 1.0f) {
+      c16 = (uint32_t)(powf(v / 255.0f, gammaExponent) * 65280.0f + 0.5f);
+      if(c16 > 65280) c16 = 65280;
+    }
+    gammaCurve[v] = c16;
+  }
+  curveStale = false;
+}
+
+// Rebuild the per-channel output tables.  Each entry folds gamma, color
+// correction and brightness into a single lookup, so the encoders pay one
+// load per byte no matter which of them are in use.  Only runs from show()
+// after one of those settings changed, and is an integer pass over the
+// cached gamma curve.
+void Adafruit_NeoPixel::updateOutputLut(void) {
+  if(curveStale) updateGammaCurve();
+  uint16_t channelScale[4];
+  for(uint8_t ch = 0; ch < 4; ch++) {
+    channelScale[ch] = (((brightnessScale(brightness) * (colorCorrection[ch] + 1)) >> 8) * powerScale) >> 8;
+  }
+  for(uint16_t v = 0; v < 256; v++) {
+    uint16_t c = (gammaCurve[v] + 128) >> 8;
+    for(uint8_t ch = 0; ch < 4; ch++) {
+      channelLut[ch][v] = (c * channelScale[ch]) >> 8;
+    }
+#if NEOPIXEL_SPI_OUTPUT
+    // Same curve with 8 more bits, before anything is rounded away
+    if(ditherLut) {
+      for(uint8_t ch = 0; ch < 4; ch++) {
+        ditherLut[ch][v] = ((uint32_t)gammaCurve[v] * channelScale[ch]) >> 8;
+      }
+    }
+#endif
+  }
+
+  // Table for each byte position within a pixel, in the strip's color order
+  if(layout.bytesPerPixel == 4) byteLut[layout.w] = channelLut[3];
+  byteLut[layout.r] = channelLut[0];
+  byteLut[layout.g] = channelLut[1];
+  byteLut[layout.b] = channelLut[2];
+#if NEOPIXEL_SPI_OUTPUT
+  if(ditherLut) {
+    if(layout.bytesPerPixel == 4) byteDitherLut[layout.w] = ditherLut[3];
+    byteDitherLut[layout.r] = ditherLut[0];
+    byteDitherLut[layout.g] = ditherLut[1];
+    byteDitherLut[layout.b] = ditherLut[2];
+  }
+#endif
+  lutStale = false;
+  paletteStale = true; // the encoded palette used the old tables
+}
+
 //Return the brightness value
 uint8_t Adafruit_NeoPixel::getBrightness(void) const {
   return brightness - 1;
@@ -1478,4 +2073,59 @@ uint8_t Adafruit_NeoPixel::getBrightness(void) const {
 
 void Adafruit_NeoPixel::clear(void) {
   memset(pixels, 0, numBytes);
+  powerSum = 0;
+  if (palette) powerRescan = true; // index 0 need not be black
+  touchAll();
+}
+
+// True if any pixel has been written since the last show()
+bool Adafruit_NeoPixel::isDirty(void) const {
+  return dirtyFirst <= dirtyLast;
+}
+
+// Flag 'count' pixels starting at 'first' as changed.  Only needed after
+// writing to the buffer returned by getPixels() directly.
+void Adafruit_NeoPixel::markDirty(uint16_t first, uint16_t count) {
+  if (first >= numLEDs || count == 0) return;
+  if (count > numLEDs - first) count = numLEDs - first;
+  powerRescan = true; // the old bytes are gone, recount on the next show()
+  touch(first, first + count - 1);
+}
+
+// Add 'strip' to the group.  Returns false once the group is full.
+bool Adafruit_NeoPixelGroup::add(Adafruit_NeoPixel &strip) {
+  if (count >= NEOPIXEL_GROUP_MAX) return false;
+  strips[count++] = &strip;
+  return true;
+}
+
+void Adafruit_NeoPixelGroup::begin(void) {
+  for (uint8_t i = 0; i < count; i++) strips[i]->begin();
+}
+
+// Send every strip and wait once.  With the strips on different SPI
+// interfaces the transfers overlap, so the frame takes as long as the
+// longest strip rather than the sum of all of them.
+void Adafruit_NeoPixelGroup::show(void) {
+  showAsync();
+  waitShow();
+}
+
+// Start every strip's frame back to back without waiting.  Each strip is
+// encoded while the previous one is already on the wire; strips sharing an
+// interface are sent one after another.
+void Adafruit_NeoPixelGroup::showAsync(void) {
+  for (uint8_t i = 0; i < count; i++) strips[i]->showAsync();
+}
+
+bool Adafruit_NeoPixelGroup::isShowing(void) {
+  bool showing = false;
+  for (uint8_t i = 0; i < count; i++) {
+    if (strips[i]->isShowing()) showing = true; // poll all to retire finished transfers
+  }
+  return showing;
+}
+
+void Adafruit_NeoPixelGroup::waitShow(void) {
+  for (uint8_t i = 0; i < count; i++) strips[i]->waitShow();
 }
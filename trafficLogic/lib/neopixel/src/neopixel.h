@@ -68,26 +68,112 @@
 #define WS2812B_FAST   0x07 // 800 KHz datastream (NeoPixel)
 #define WS2812B2_FAST  0x08 // 800 KHz datastream (NeoPixel)
 
+// Byte offset of each color channel within one pixel, and the number of
+// bytes per pixel, for a pixel type.  constexpr so NeoPixelStrip can resolve
+// it at compile time; Adafruit_NeoPixel resolves it once in its constructor.
+struct NeoPixelLayout {
+  uint8_t r, g, b, w, bytesPerPixel;
+};
+
+constexpr NeoPixelLayout neoPixelLayout(uint8_t t) {
+  return (t == WS2812B || t == WS2812B_FAST || t == WS2812B2 || t == WS2812B2_FAST)
+           ? NeoPixelLayout{ 1, 0, 2, 0, 3 } // WS2812, WS2812B & WS2813 is GRB order
+       : (t == TM1829)
+           ? NeoPixelLayout{ 0, 2, 1, 0, 3 } // TM1829 is special RBG order
+       : (t == SK6812RGBW)
+           ? NeoPixelLayout{ 0, 1, 2, 3, 4 } // SK6812RGBW is RGBW order
+           : NeoPixelLayout{ 0, 1, 2, 0, 3 }; // WS2811, TM1803 & default is RGB order
+}
+
+#if (PLATFORM_ID == 32) || (PLATFORM_ID == 6) || (PLATFORM_ID == 8) || (PLATFORM_ID == 10) || (PLATFORM_ID == 88)
+// Strips built on a SPIClass send each neopixel bit as a fixed pattern of SPI
+// bits from the MOSI pin using DMA.  The frame carries no reset padding: the
+// latch time is tracked from the end of the previous transfer like the other
+// outputs do.  This is the only output on P2; Photon, P1, Electron and Duo
+// can also bit-bang a pin.
+#define NEOPIXEL_SPI_OUTPUT 1
+
+#if (PLATFORM_ID == 32)
+#define NEOPIXEL_SPI_BITS_PER_BIT 3       // 110 / 100 at 320ns per SPI bit
+#define NEOPIXEL_SPI_CLOCK        3125000
+#else
+#define NEOPIXEL_SPI_BITS_PER_BIT 4       // 1110 / 1000 at 267ns per SPI bit
+#define NEOPIXEL_SPI_CLOCK        3750000 // SPI 60MHz/16, SPI1 30MHz/8
+#endif
+
+// One zero byte after the pixel data, so MOSI is left LOW once the last
+// cell has been shifted out even if DMA completion fires a little early.
+#define NEOPIXEL_SPI_TAIL_BYTES 1
+
+// Pixel types the SPI output can send: the 800 KHz WS2812 family and
+// SK6812RGBW, and 400 KHz WS2811 at half the SPI clock.
+constexpr bool neoPixelSpiSupports(uint8_t t) {
+  return t == WS2812B || t == WS2812B_FAST || t == WS2812B2 || t == WS2812B2_FAST ||
+         t == SK6812RGBW || t == WS2811;
+}
+
+constexpr uint32_t neoPixelSpiClock(uint8_t t) {
+  return (t == WS2811) ? NEOPIXEL_SPI_CLOCK / 2 : NEOPIXEL_SPI_CLOCK;
+}
+
+// Bytes in one encoded SPI frame for n pixels of type t
+constexpr uint32_t neoPixelSpiFrameSize(uint16_t n, uint8_t t) {
+  return ((uint32_t)n * neoPixelLayout(t).bytesPerPixel * NEOPIXEL_SPI_BITS_PER_BIT) +
+         NEOPIXEL_SPI_TAIL_BYTES;
+}
+
+// Bytes needed for the front and back SPI buffers
+constexpr uint32_t neoPixelSpiBufferSize(uint16_t n, uint8_t t) {
+  return 2 * neoPixelSpiFrameSize(n, t);
+}
+#endif // NEOPIXEL_SPI_OUTPUT
+
+// Quiescent current of one pixel in mA, for the setPowerBudget() estimate
+#define NEOPIXEL_IDLE_MILLIAMPS 1
+
+// The power budget dims in steps of this many 256ths, so small changes in
+// the estimate don't re-encode the strip
+#define NEOPIXEL_POWER_SCALE_STEP 8
+
 class Adafruit_NeoPixel {
 
  public:
 
-  // Constructor: number of LEDs, pin number, LED type
-#if (PLATFORM_ID == 32)
+  // Constructor: number of LEDs, SPI interface or pin number, LED type
+#if NEOPIXEL_SPI_OUTPUT
   Adafruit_NeoPixel(uint16_t n, SPIClass& spi, uint8_t t=WS2812B);
-#else
+#endif
+#if (PLATFORM_ID != 32)
   Adafruit_NeoPixel(uint16_t n, uint8_t p=2, uint8_t t=WS2812B);
-#endif // #if (PLATFORM_ID == 32)
+#endif
+  // Constructor on caller-provided storage (see attachBuffer())
+#if NEOPIXEL_SPI_OUTPUT
+  Adafruit_NeoPixel(uint16_t n, SPIClass& spi, uint8_t t, uint8_t *pixelStorage,
+                    uint8_t *spiStorage, bool clearPixels=true);
+#endif
+#if (PLATFORM_ID != 32)
+  Adafruit_NeoPixel(uint16_t n, uint8_t p, uint8_t t, uint8_t *pixelStorage,
+                    bool clearPixels=true);
+#endif
   ~Adafruit_NeoPixel();
 
   void
     begin(void),
     show(void) __attribute__((optimize("Ofast"))),
+    showAsync(void) __attribute__((optimize("Ofast"))),
+    waitShow(void),
     setPin(uint8_t p),
     setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b),
     setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w),
     setPixelColor(uint16_t n, uint32_t c),
+    setPixelColorHSV(uint16_t n, uint16_t hue, uint8_t sat=255, uint8_t val=255),
+    fill(uint32_t c=0, uint16_t first=0, uint16_t count=0),
+    setPixels(uint16_t first, const uint32_t *colors, uint16_t count),
+    writeRaw(uint16_t first, const uint8_t *nativeBytes, uint16_t len),
     setBrightness(uint8_t),
+    setGamma(float g),
+    setColorCorrection(uint8_t r, uint8_t g, uint8_t b, uint8_t w=255),
+    setPowerBudget(uint16_t milliamps, uint8_t channelMa=20),
     setColor(uint16_t aLedNumber, byte aRed, byte aGreen, byte aBlue),
     setColor(uint16_t aLedNumber, byte aRed, byte aGreen, byte aBlue, byte aWhite),
     setColorScaled(uint16_t aLedNumber, byte aRed, byte aGreen, byte aBlue, byte aScaling),
@@ -95,42 +181,293 @@ class Adafruit_NeoPixel {
     setColorDimmed(uint16_t aLedNumber, byte aRed, byte aGreen, byte aBlue, byte aBrightness),
     setColorDimmed(uint16_t aLedNumber, byte aRed, byte aGreen, byte aBlue, byte aWhite, byte aBrightness),
     updateLength(uint16_t n),
+    markDirty(uint16_t first, uint16_t count),
+    setPaletteColor(uint8_t i, uint32_t c),
+    setPixelIndex(uint16_t n, uint8_t i),
+    fillIndex(uint8_t i, uint16_t first=0, uint16_t count=0),
     clear(void);
   uint8_t
    *getPixels() const,
     getBrightness(void) const,
     getPin() const,
-    getType() const;
+    getType() const,
+    getPixelIndex(uint16_t n) const;
+  bool
+    attachBuffer(uint16_t n, uint8_t *pixelStorage, uint8_t *spiStorage=NULL,
+                 bool clearPixels=true),
+    setPalette(const uint32_t *colors, uint16_t count),
+    setDithering(bool enable, uint16_t pixelsPerFrame=0),
+    isDithering(void) const,
+    isPaletteMode(void) const,
+    isShowing(void),
+    isDirty(void) const;
   uint16_t
     numPixels(void) const,
     getNumLeds(void) const;
   static uint32_t
     Color(uint8_t r, uint8_t g, uint8_t b),
-    Color(uint8_t r, uint8_t g, uint8_t b, uint8_t w);
+    Color(uint8_t r, uint8_t g, uint8_t b, uint8_t w),
+    ColorHSV(uint16_t hue, uint8_t sat=255, uint8_t val=255);
   uint32_t
-    getPixelColor(uint16_t n) const;
+    getPixelColor(uint16_t n) const,
+    getPaletteColor(uint8_t i) const,
+    getPowerEstimate(void);
+  float
+    getGamma(void) const;
   byte
     brightnessToPWM(byte aBrightness);
 
- private:
+ protected:
 
   bool
-    begun;         // true if begin() previously called
+    begun,         // true if begin() previously called
+    ownsPixels,    // true if 'pixels' was allocated by updateLength()
+    fixedStorage;  // true if attachBuffer()/updateLength() must not replace the storage
   uint16_t
     numLEDs,       // Number of RGB LEDs in strip
     numBytes;      // Size of 'pixels' buffer below
   const uint8_t
     type;          // Pixel type flag (400 vs 800 KHz)
+  const NeoPixelLayout
+    layout;        // Color order and bytes per pixel for 'type'
   uint8_t
     pin,           // Output pin number
     brightness,
    *pixels;        // Holds LED color values (3 bytes each)
   uint32_t
     endTime;       // Latch timing reference
-#if (PLATFORM_ID == 32)
+  uint16_t
+    dirtyFirst,    // First and last pixel written since the last show()
+    dirtyLast;     // (empty when dirtyFirst > dirtyLast)
+  float
+    gammaExponent; // Output gamma (1.0 = linear)
+  uint8_t
+    colorCorrection[4]; // Output R,G,B,W scale (255 = none)
+  bool
+    lutStale,      // true when the output tables need rebuilding
+    curveStale;    // true when 'gammaCurve' needs rebuilding
+  uint16_t
+    gammaCurve[256]; // Gamma curve in 8.8 fixed point, shared by all channels
+  uint8_t
+    channelLut[4][256]; // R,G,B,W output tables: brightness+gamma+correction
+  const uint8_t
+   *byteLut[4];    // channelLut for each byte position in the color order
+  uint8_t
+   *palette,       // Palette colors in strip byte order (NULL = full color)
+   *paletteSpi,    // The same colors encoded for SPI output
+    paletteMask;   // Palette size - 1 (15 or 255); indexes are masked with it
+  bool
+    paletteStale;  // true when 'paletteSpi' needs re-encoding
+  uint16_t
+    powerBudget,   // Supply current limit in mA (0 = no limit, nothing tracked)
+    powerScale;    // Output scale the limit needs, 256 = full
+  uint8_t
+    channelMilliamps; // Current of one color channel at full output
+  bool
+    powerRescan;   // true when 'powerSum' must be recounted from the buffer
+  uint32_t
+    powerSum;      // Sum of all pixel bytes, kept while a budget is set
+#if NEOPIXEL_SPI_OUTPUT
   SPIClass*
-    spi_;
+    spi_;          // SPI output interface (NULL for a bit-banged pin)
+  uint8_t
+   *spiArray[2];   // Front/back SPI encode buffers (allocated in updateLength())
+  uint32_t
+    spiArraySize;  // Size of each 'spiArray' buffer including the tail byte
+  uint8_t
+    spiBack;       // Index of the buffer the next frame is encoded into
+  bool
+    spiShowing,    // true while a showAsync() frame is on the wire
+    ownsSpiArray;  // true if 'spiArray' was allocated by updateLength()
+  uint16_t
+    spiStaleFirst[2], // Pixel range each SPI buffer has not encoded yet
+    spiStaleLast[2];
+  uint16_t
+    (*ditherLut)[256], // R,G,B,W output tables in 8.8 fixed point (NULL = no dithering)
+    ditherStep,    // Pixels re-encoded per frame to move the dither (0 = all)
+    ditherCursor[2]; // Next pixel to re-encode in each SPI buffer
+  const uint16_t
+   *byteDitherLut[4]; // ditherLut for each byte position in the color order
+  uint8_t
+    ditherPass[2]; // Times each SPI buffer has been re-encoded all round
+#elif HAL_PLATFORM_NRF52840
+  int8_t
+    pwmIndex;      // PWM instance reserved in begin() (-1 = none)
+  uint16_t
+   *pwmPattern;    // EasyDMA duty cycle pattern, one entry per bit
 #endif
+
+#if HAL_PLATFORM_NRF52840
+  bool
+    reservePwm(void),
+    allocPwmPattern(void);
+#endif
+  void
+    touch(uint16_t first, uint16_t last),
+    touchAll(void),
+    powerSub(const uint8_t *p, uint16_t len),
+    powerAdd(const uint8_t *p, uint16_t len),
+    updatePowerScale(void),
+    updateGammaCurve(void),
+    updateOutputLut(void),
+    releasePalette(void),
+    releaseStorage(void),
+#if NEOPIXEL_SPI_OUTPUT
+    attachStorage(uint16_t n, uint8_t *pixelStorage, uint8_t *spiStorage, bool clearPixels=true);
+#else
+    attachStorage(uint16_t n, uint8_t *pixelStorage, bool clearPixels=true);
+#endif
+};
+
+// Grow the range of pixels changed since the last show() to cover first..last
+inline void Adafruit_NeoPixel::touch(uint16_t first, uint16_t last) {
+  if (first < dirtyFirst) dirtyFirst = first;
+  if (last > dirtyLast) dirtyLast = last;
+}
+
+// Keep 'powerSum' in step with a write of 'len' pixel bytes at 'p': call
+// powerSub() before the bytes change and powerAdd() after.  Nothing is
+// counted while no power budget is set.
+inline void Adafruit_NeoPixel::powerSub(const uint8_t *p, uint16_t len) {
+  if (powerBudget) while (len--) powerSum -= *p++;
+}
+
+inline void Adafruit_NeoPixel::powerAdd(const uint8_t *p, uint16_t len) {
+  if (powerBudget) while (len--) powerSum += *p++;
+}
+
+// Strip with its pixel type and length fixed at compile time, e.g.
+//   NeoPixelStrip<WS2812B, 64> strip(SPI1);
+// The pixel and SPI storage are members of each strip object (no malloc),
+// and setPixelColor()/getPixelColor() use constant bounds, byte order and
+// bytes per pixel instead of branching on the runtime type.  Everything
+// else (show(), fill(), brightness...) is shared with Adafruit_NeoPixel.
+//
+// Code holding the strip as an Adafruit_NeoPixel& reaches the base
+// setPixelColor()/getPixelColor(), which write the same storage the slower
+// way, and an attachBuffer() or updateLength() through it fails.  On
+// Photon, P1, Electron and Duo a strip built on a pin still carries the SPI
+// buffers; use Adafruit_NeoPixel there if the RAM matters.
+template <uint8_t TYPE, uint16_t COUNT>
+class NeoPixelStrip : public Adafruit_NeoPixel {
+
+ public:
+
+#if NEOPIXEL_SPI_OUTPUT
+  NeoPixelStrip(SPIClass& spi) :
+    Adafruit_NeoPixel(COUNT, spi, TYPE, pixelStorage, spiStorage) {
+    fixedStorage = true;
+  }
+#endif
+#if (PLATFORM_ID != 32)
+  NeoPixelStrip(uint8_t p=2) :
+    Adafruit_NeoPixel(COUNT, p, TYPE, pixelStorage) {
+    fixedStorage = true;
+  }
+#endif
+
+  static constexpr uint8_t
+    BYTES_PER_PIXEL = neoPixelLayout(TYPE).bytesPerPixel,
+    R = neoPixelLayout(TYPE).r,
+    G = neoPixelLayout(TYPE).g,
+    B = neoPixelLayout(TYPE).b,
+    W = neoPixelLayout(TYPE).w;
+
+  // The storage is fixed at compile time and used directly by the methods
+  // below, so the strip can't be resized or moved to other storage.  These
+  // catch direct calls; calls through the base class fail at run time.
+  bool attachBuffer(uint16_t n, uint8_t *pixelStorage, uint8_t *spiStorage=NULL,
+                    bool clearPixels=true) = delete;
+  void updateLength(uint16_t n) = delete;
+
+  void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
+    if(n < COUNT) {
+      if(TYPE == TM1829 && r == 255) r = 254; // 255 on RED channel causes display to be in a special mode.
+      touch(n, n);
+      uint8_t *p = &pixelStorage[n * BYTES_PER_PIXEL];
+      powerSub(p, BYTES_PER_PIXEL);
+      p[R] = r;
+      p[G] = g;
+      p[B] = b;
+      if(BYTES_PER_PIXEL == 4) p[W] = w;
+      powerAdd(p, BYTES_PER_PIXEL);
+    }
+  }
+
+  void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
+    if(n < COUNT) {
+      if(TYPE == TM1829 && r == 255) r = 254; // 255 on RED channel causes display to be in a special mode.
+      touch(n, n);
+      uint8_t *p = &pixelStorage[n * BYTES_PER_PIXEL];
+      powerSub(p, BYTES_PER_PIXEL);
+      p[R] = r;
+      p[G] = g;
+      p[B] = b;
+      powerAdd(p, BYTES_PER_PIXEL);
+    }
+  }
+
+  void setPixelColor(uint16_t n, uint32_t c) {
+    setPixelColor(n, (uint8_t)(c >> 16), (uint8_t)(c >> 8), (uint8_t)c, (uint8_t)(c >> 24));
+  }
+
+  uint32_t getPixelColor(uint16_t n) const {
+    if(n >= COUNT) return 0;
+    const uint8_t *p = &pixelStorage[n * BYTES_PER_PIXEL];
+    uint32_t c = ((uint32_t)p[R] << 16) | ((uint32_t)p[G] << 8) | (uint32_t)p[B];
+    if(BYTES_PER_PIXEL == 4) c |= (uint32_t)p[W] << 24;
+    return c;
+  }
+
+  static constexpr uint16_t numPixels(void) {
+    return COUNT;
+  }
+
+ private:
+
+  uint8_t
+    pixelStorage[COUNT * BYTES_PER_PIXEL];
+#if NEOPIXEL_SPI_OUTPUT
+  uint8_t
+    spiStorage[neoPixelSpiBufferSize(COUNT, TYPE)];
+#endif
+};
+
+#define NEOPIXEL_GROUP_MAX 4
+
+// Drives several strips as one display: show() starts every strip's frame
+// and then waits once.  On the P2, put each strip on its own SPI interface
+// (SPI and SPI1) so the DMA transfers run in parallel; the group does not
+// own the strips.
+class Adafruit_NeoPixelGroup {
+
+ public:
+
+  Adafruit_NeoPixelGroup(void) : count(0) {}
+  Adafruit_NeoPixelGroup(Adafruit_NeoPixel &a, Adafruit_NeoPixel &b) : count(0) {
+    add(a);
+    add(b);
+  }
+
+  bool
+    add(Adafruit_NeoPixel &strip),
+    isShowing(void);
+  void
+    begin(void),
+    show(void),
+    showAsync(void),
+    waitShow(void);
+  uint8_t
+    numStrips(void) const { return count; }
+  Adafruit_NeoPixel
+   &getStrip(uint8_t i) const { return *strips[i]; }
+
+ private:
+
+  Adafruit_NeoPixel
+   *strips[NEOPIXEL_GROUP_MAX];
+  uint8_t
+    count;
 };
 
 #endif // PARTICLE_NEOPIXEL_H
@@ -0,0 +1,185 @@
+/* ======================= neopixel_encode.h ======================= */
+/*--------------------------------------------------------------------
+  This file is part of the Adafruit NeoPixel library.
+
+  NeoPixel is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  NeoPixel is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with NeoPixel.  If not, see
+  <http://www.gnu.org/licenses/>.
+  --------------------------------------------------------------------*/
+
+// WS2812 over SPI wire format.
+//
+// Each neopixel bit is sent MSB first as a cell of BITS SPI bits: HI for a
+// '1', LO for a '0'.  Both start HIGH and end LOW; the number of leading
+// 1s times the SPI bit time is the pulse the pixel sees (T0H / T1H).  A
+// color byte is therefore exactly BITS SPI bytes, and a frame is
+//
+//   [pixel 0 byte 0 .. pixel n-1 last byte][zero tail]
+//
+// with the bytes of each pixel in the strip's color order.  The tail only
+// leaves the line LOW; the reset (latch) time is waited out by the driver
+// before the next frame starts rather than sent as zeros.
+//
+// This header has no Particle dependencies so the tables and the encoder
+// can be built and checked anywhere; neopixel.cpp verifies every table
+// entry and the pulse timings at compile time, and test/host decodes whole
+// frames from the SPI output.
+
+#ifndef PARTICLE_NEOPIXEL_ENCODE_H
+#define PARTICLE_NEOPIXEL_ENCODE_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Expansion of every byte value, precomputed so the encoder is one table
+// load and BITS stores per color byte.  Codes with the same cell width share
+// the table type, so a strip can pick its table at run time.
+template <uint8_t BITS>
+struct NeoPixelSpiLut {
+  uint8_t bytes[256][BITS];
+};
+
+template <uint8_t BITS, uint8_t HI, uint8_t LO>
+struct NeoPixelSpiCode {
+
+  static constexpr uint8_t
+    BITS_PER_BIT = BITS,
+    CELL_HI = HI,  // cell sent for a neopixel '1'
+    CELL_LO = LO;  // cell sent for a neopixel '0'
+
+  typedef NeoPixelSpiLut<BITS> Lut;
+
+  static constexpr Lut makeLut() {
+    Lut lut = {};
+    for (int v = 0; v < 256; v++) {
+      uint32_t bits = 0;
+      for (int mask = 0x80; mask; mask >>= 1) {
+        bits = (bits << BITS) | ((v & mask) ? HI : LO);
+      }
+      for (int i = 0; i < BITS; i++) {
+        lut.bytes[v][i] = (uint8_t)(bits >> (8 * (BITS - 1 - i)));
+      }
+    }
+    return lut;
+  }
+
+  // Decode one encoded color byte back into its value, or -1 if any cell is
+  // neither HI nor LO.
+  static constexpr int decode(const uint8_t *cells) {
+    uint32_t bits = 0;
+    for (int i = 0; i < BITS; i++) {
+      bits = (bits << 8) | cells[i];
+    }
+    int v = 0;
+    for (int i = 7; i >= 0; i--) {
+      uint8_t cell = (bits >> (i * BITS)) & ((1 << BITS) - 1);
+      if (cell != HI && cell != LO) return -1;
+      v = (v << 1) | (cell == HI);
+    }
+    return v;
+  }
+
+  // True if every table entry decodes back to its own index
+  static constexpr bool roundTrips(const Lut &lut) {
+    for (int v = 0; v < 256; v++) {
+      if (decode(lut.bytes[v]) != v) return false;
+    }
+    return true;
+  }
+
+  // Length of the HIGH pulse a cell produces at 'clock' Hz, in ns
+  static constexpr uint32_t highNs(uint8_t cell, uint32_t clock) {
+    uint8_t ones = 0;
+    for (int i = BITS - 1; i >= 0 && ((cell >> i) & 1); i--) ones++;
+    return (uint32_t)(ones * 1000000000ULL / clock);
+  }
+
+  // Length of one neopixel bit at 'clock' Hz, in ns
+  static constexpr uint32_t bitNs(uint32_t clock) {
+    return (uint32_t)(BITS * 1000000000ULL / clock);
+  }
+
+};
+
+// Expand 'count' pixels of 'bytesPerPixel' bytes from 'src' into 'dst',
+// passing byte k of each pixel through byteLut[k] first.  Returns the end
+// of the encoded data.
+template <uint8_t BITS>
+inline uint8_t *neoPixelSpiEncode(uint8_t *dst, const uint8_t *src, uint16_t count,
+                                  uint8_t bytesPerPixel, const uint8_t *const byteLut[4],
+                                  const NeoPixelSpiLut<BITS> &lut) {
+  for (uint16_t n = 0; n < count; n++) {
+    for (uint8_t k = 0; k < bytesPerPixel; k++) {
+      memcpy(dst, lut.bytes[byteLut[k][*src++]], BITS);
+      dst += BITS;
+    }
+  }
+  return dst;
+}
+
+// Thresholds for temporal dithering, in the order they are used.  Spread
+// evenly over 0-255 so that, over 8 frames, a value's fraction of 1/256ths
+// turns into the same fraction of frames rounded up.
+static constexpr uint8_t neoPixelDitherThresholds[8] = { 16, 144, 80, 208, 48, 176, 112, 240 };
+
+// As neoPixelSpiEncode, but the tables hold 8.8 fixed point values and the
+// fraction is dithered: pixel n (counting from 'first') is rounded with
+// threshold (phase + n) & 7, so neighbouring pixels and successive phases
+// round at different points.
+template <uint8_t BITS>
+inline uint8_t *neoPixelSpiEncodeDithered(uint8_t *dst, const uint8_t *src, uint16_t first,
+                                          uint16_t count, uint8_t bytesPerPixel,
+                                          const uint16_t *const byteLut[4],
+                                          const NeoPixelSpiLut<BITS> &lut, uint8_t phase) {
+  for (uint16_t n = 0; n < count; n++) {
+    uint8_t threshold = neoPixelDitherThresholds[(phase + first + n) & 7];
+    for (uint8_t k = 0; k < bytesPerPixel; k++) {
+      memcpy(dst, lut.bytes[(byteLut[k][*src++] + threshold) >> 8], BITS);
+      dst += BITS;
+    }
+  }
+  return dst;
+}
+
+// Copy the pre-encoded palette entry for each of 'count' indexes in 'src'
+// into 'dst', for entries of ENTRY_BYTES bytes.  The constant size lets the
+// copy compile to a few fixed-width moves instead of a memcpy call.
+template <uint8_t ENTRY_BYTES>
+inline uint8_t *neoPixelSpiEncodeIndexed(uint8_t *dst, const uint8_t *src, uint16_t count,
+                                         const uint8_t *entries, uint8_t mask) {
+  for (uint16_t n = 0; n < count; n++) {
+    memcpy(dst, &entries[(src[n] & mask) * ENTRY_BYTES], ENTRY_BYTES);
+    dst += ENTRY_BYTES;
+  }
+  return dst;
+}
+
+// As above for an entry size known only at run time: 'entryBytes' is the
+// pixel's bytes times the SPI bits per bit.  Indexes are masked with 'mask'
+// so any byte value is safe.  Returns the end of the encoded data.
+inline uint8_t *neoPixelSpiEncodeIndexed(uint8_t *dst, const uint8_t *src, uint16_t count,
+                                         const uint8_t *entries, uint8_t entryBytes,
+                                         uint8_t mask) {
+  switch (entryBytes) {
+    case 9:  return neoPixelSpiEncodeIndexed<9>(dst, src, count, entries, mask);  // RGB, 3 bit cells
+    case 12: return neoPixelSpiEncodeIndexed<12>(dst, src, count, entries, mask); // RGBW 3 or RGB 4
+    case 16: return neoPixelSpiEncodeIndexed<16>(dst, src, count, entries, mask); // RGBW, 4 bit cells
+  }
+  for (uint16_t n = 0; n < count; n++) {
+    memcpy(dst, &entries[(src[n] & mask) * entryBytes], entryBytes);
+    dst += entryBytes;
+  }
+  return dst;
+}
+
+#endif // PARTICLE_NEOPIXEL_ENCODE_H
@@ -0,0 +1,93 @@
+// Stand-in for the Device OS headers, just enough to build neopixel.cpp
+// for the P2 (PLATFORM_ID 32) SPI output on a desktop compiler.  SPIClass
+// and micros() are implemented in host_spi.cpp, which records every frame
+// handed to the SPI DMA (see host_spi.h).
+
+#ifndef HOST_PARTICLE_H
+#define HOST_PARTICLE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PLATFORM_ID
+#define PLATFORM_ID 32
+#endif
+#if PLATFORM_ID != 32
+#error "the host harness models the P2 SPI output only"
+#endif
+
+typedef uint8_t byte;
+typedef uint16_t pin_t;
+
+#define PIN_INVALID 0xFFFF
+#define LOW  0
+#define HIGH 1
+#define MSBFIRST 1
+#define SPI_MODE0 0
+#define SCK   20
+#define MISO  21
+#define SCK1  22
+#define MISO1 23
+
+#define SYSTEM_VERSION 0x05080000
+#define SYSTEM_VERSION_ALPHA(a, b, c, d) (((a) << 24) | ((b) << 16) | ((c) << 8))
+
+enum PinMode { INPUT, OUTPUT };
+inline PinMode getPinMode(pin_t) { return INPUT; }
+inline void pinMode(pin_t, PinMode) {}
+inline int32_t digitalRead(pin_t) { return LOW; }
+inline void digitalWrite(pin_t, uint8_t) {}
+
+uint32_t micros(void);
+uint32_t millis(void);
+inline void delay(uint32_t) {}
+inline void delayMicroseconds(uint32_t) {}
+inline void __disable_irq(void) {}
+inline void __enable_irq(void) {}
+
+// SPI HAL
+#define HAL_PLATFORM_SPI_NUM 2
+#define HAL_SPI_INTERFACE1 0
+#define HAL_SPI_INTERFACE2 1
+#define SPI_MODE_MASTER 0
+#define HAL_SPI_CONFIG_VERSION 1
+#define HAL_SPI_CONFIG_FLAG_MOSI_ONLY 0x01
+
+struct hal_spi_config_t {
+  uint16_t size;
+  uint16_t version;
+  uint32_t flags;
+};
+int hal_spi_begin_ext(int spi, int mode, pin_t ssPin, hal_spi_config_t *config);
+
+typedef void (*wiring_spi_dma_transfercomplete_callback_t)(void);
+
+class SPIClass {
+ public:
+  explicit SPIClass(int spi) : spi(spi) {}
+
+  int interface(void) const { return spi; }
+  void begin(pin_t ssPin = PIN_INVALID);
+  void end(void) {}
+  void setBitOrder(uint8_t) {}
+  void setDataMode(uint8_t) {}
+  void setClockSpeed(unsigned clock);
+  int32_t beginTransaction(void);
+  void endTransaction(void);
+  void transfer(const void *tx, void *rx, size_t length,
+                wiring_spi_dma_transfercomplete_callback_t callback);
+
+ private:
+  int spi;
+};
+
+extern SPIClass SPI, SPI1;
+
+struct Logger {
+  void error(const char *format, ...) const;
+};
+
+extern Logger Log;
+
+#endif // HOST_PARTICLE_H
@@ -0,0 +1,145 @@
+// Encode speed of the P2 WS2812 SPI expander, before and after the lookup
+// table: the per-bit ternaries show() used to run, against the 256-entry
+// table in neopixel_encode.h.  Both are checked to produce the same bytes
+// for every value first.  Palette mode is timed against the table encoder
+// too, since setPalette() is documented as the cheaper path.  The figures depend on the host and the build, so
+// both are printed with them.
+//
+//   make bench
+
+#include "neopixel_encode.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#ifndef BENCH_BUILD
+#define BENCH_BUILD "unknown flags"
+#endif
+
+typedef NeoPixelSpiCode<3, 0b110, 0b100> Ws2812SpiCode;
+static constexpr Ws2812SpiCode::Lut ws2812SpiLut = Ws2812SpiCode::makeLut();
+
+// The loop from show() before the table, minus the malloc, memset and reset
+// padding around it
+static void encodeBefore(uint8_t *spiArray, const uint8_t *pixels, uint16_t numPixels) {
+  constexpr uint8_t PIX_HI = 0b110;
+  constexpr uint8_t PIX_LO = 0b100;
+  for (int x = 0; x < numPixels; x++) {
+    for (int s = 0; s < 3; s++) {
+      spiArray[(x*9)+(s*3)+0] = ((0x80 & pixels[(x*3)+s])?(PIX_HI << 5):(PIX_LO << 5)) + ((0x40 & pixels[(x*3)+s])?(PIX_HI << 2):(PIX_LO << 2)) + ((0x20 & pixels[(x*3)+s])?(0b11):(0b10));
+      spiArray[(x*9)+(s*3)+1] = 0 /* bit 7 always 0 */ + ((0x10 & pixels[(x*3)+s])?(PIX_HI << 4):(PIX_LO << 4)) + ((0x08 & pixels[(x*3)+s])?(PIX_HI << 1):(PIX_LO << 1)) + 1 /* bit 0 always 1 */;
+      spiArray[(x*9)+(s*3)+2] = ((0x04 & pixels[(x*3)+s])?(0b10 << 6):(0b00 << 6)) + ((0x02 & pixels[(x*3)+s])?(PIX_HI << 3):(PIX_LO << 3)) + ((0x01 & pixels[(x*3)+s])?(PIX_HI):(PIX_LO));
+    }
+  }
+}
+
+// The table encoder as showAsync() calls it, with identity output tables
+static uint8_t identity[256];
+static const uint8_t *const byteLut[4] = { identity, identity, identity, identity };
+
+static void encodeAfter(uint8_t *spiArray, const uint8_t *pixels, uint16_t numPixels) {
+  neoPixelSpiEncode(spiArray, pixels, numPixels, 3, byteLut, ws2812SpiLut);
+}
+
+// Palette mode as showAsync() calls it: 16 colors encoded once, then one
+// entry copy per pixel.  The entry size is passed at run time as it is there.
+static uint8_t paletteSpi[16 * 9];
+
+static void encodePalette(uint8_t *spiArray, const uint8_t *indexes, uint16_t numPixels) {
+  neoPixelSpiEncodeIndexed(spiArray, indexes, numPixels, paletteSpi, 9, 15);
+}
+
+static volatile uint8_t sink;
+
+// Median ns per pixel over 'runs' encodes of the same frame
+static double nsPerPixel(void (*encode)(uint8_t *, const uint8_t *, uint16_t),
+                         const std::vector<uint8_t> &pixels, uint16_t numPixels) {
+  const int runs = 2001;
+  std::vector<uint8_t> spi(numPixels * 9);
+  std::vector<double> ns;
+  for (int r = 0; r < runs; r++) {
+    auto start = std::chrono::steady_clock::now();
+    encode(spi.data(), pixels.data(), numPixels);
+    ns.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+  }
+  sink = spi[numPixels * 9 - 1]; // keep the encode
+  std::sort(ns.begin(), ns.end());
+  return ns[runs / 2] / numPixels;
+}
+
+// First "model name" line of /proc/cpuinfo, where there is one
+static void printHost(void) {
+  char line[256];
+  FILE *f = fopen("/proc/cpuinfo", "r");
+  while (f && fgets(line, sizeof(line), f)) {
+    if (strncmp(line, "model name", 10) == 0) {
+      printf("host: %s", strchr(line, ':') + 2);
+      break;
+    }
+  }
+  if (f) fclose(f);
+  printf("build: %s, compiler %s\n\n", BENCH_BUILD, __VERSION__);
+}
+
+int main(void) {
+  for (int v = 0; v < 256; v++) identity[v] = v;
+  printHost();
+
+  // every byte value in every color position
+  std::vector<uint8_t> all(256 * 3);
+  for (int i = 0; i < 256 * 3; i++) all[i] = i / 3;
+  std::vector<uint8_t> before(256 * 9), after(256 * 9);
+  encodeBefore(before.data(), all.data(), 256);
+  encodeAfter(after.data(), all.data(), 256);
+  if (before != after) {
+    printf("FAIL: the table encoder does not match the original for every byte value\n");
+    return 1;
+  }
+  printf("table and original encoders agree for all 256 byte values\n\n");
+
+  printf("  pixels   before ns/pixel   after ns/pixel   speedup\n");
+  const uint16_t sizes[] = { 64, 300, 1024 };
+  for (uint16_t n : sizes) {
+    std::vector<uint8_t> pixels(n * 3);
+    for (uint8_t &c : pixels) c = rand();
+    double b = nsPerPixel(encodeBefore, pixels, n);
+    double a = nsPerPixel(encodeAfter, pixels, n);
+    printf("  %6u   %15.1f   %14.1f   %6.1fx\n", n, b, a, b / a);
+  }
+
+  uint8_t paletteColors[16 * 3];
+  for (uint8_t &c : paletteColors) c = rand();
+  encodeAfter(paletteSpi, paletteColors, 16);
+  std::vector<uint8_t> indexes(256), colors(256 * 3);
+  for (int i = 0; i < 256; i++) {
+    indexes[i] = i;
+    memcpy(&colors[i * 3], &paletteColors[(i & 15) * 3], 3);
+  }
+  encodePalette(before.data(), indexes.data(), 256);
+  encodeAfter(after.data(), colors.data(), 256);
+  if (before != after) {
+    printf("FAIL: palette frames do not match the same colors sent in full\n");
+    return 1;
+  }
+
+  printf("\n  pixels   full color ns/pixel   palette ns/pixel   speedup\n");
+  bool slower = false;
+  for (uint16_t n : sizes) {
+    std::vector<uint8_t> pixels(n * 3), paletteIndexes(n);
+    for (uint8_t &c : pixels) c = rand();
+    for (uint8_t &i : paletteIndexes) i = rand();
+    double a = nsPerPixel(encodeAfter, pixels, n);
+    double p = nsPerPixel(encodePalette, paletteIndexes, n);
+    printf("  %6u   %19.1f   %16.1f   %6.1fx\n", n, a, p, a / p);
+    slower |= p >= a;
+  }
+  if (slower) {
+    printf("FAIL: palette mode is not cheaper than full color\n");
+    return 1;
+  }
+  return 0;
+}
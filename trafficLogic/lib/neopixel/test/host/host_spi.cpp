@@ -0,0 +1,276 @@
+// Host model of the P2 SPI DMA output and a WS2812 waveform decoder.
+// See host_spi.h.
+
+#include "Particle.h"
+#include "host_spi.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdarg.h>
+#include <stdio.h>
+#include <thread>
+
+SPIClass SPI(HAL_SPI_INTERFACE1), SPI1(HAL_SPI_INTERFACE2);
+Logger Log;
+
+const HostPixelTiming hostWs2812Timing = { 200, 500, 580, 1000, 900, 1500 };
+const HostPixelTiming hostWs2811Timing = { 350, 650, 1000, 1350, 1900, 3000 };
+
+namespace {
+
+struct Transfer {
+  bool active;
+  const uint8_t *buffer;         // the caller's buffer, must not change until done
+  std::vector<uint8_t> sent;     // copy taken when the transfer started
+  uint32_t doneAt;               // micros() when the last bit has been shifted out
+  wiring_spi_dma_transfercomplete_callback_t callback;
+};
+
+const int INTERFACES = HAL_PLATFORM_SPI_NUM;
+
+std::vector<HostSpiFrame> frames;
+Transfer transfers[INTERFACES];
+uint32_t clocks[INTERFACES];
+int transactionDepth[INTERFACES];
+std::atomic<uint32_t> skew(0);
+thread_local bool inCallback;    // micros() is called from a completion callback...
+thread_local uint32_t callbackAt; // ...which runs at the time the transfer finished
+int errors;
+std::string firstError;
+
+// Held while transfers[] is read or changed.  Recursive because the
+// completion callbacks call micros().
+std::recursive_mutex &bus(void) {
+  static std::recursive_mutex *m = new std::recursive_mutex; // never destroyed, the DMA thread outlives main()
+  return *m;
+}
+
+void fail(const char *format, ...) {
+  char text[200];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  std::lock_guard<std::recursive_mutex> lock(bus());
+  if (errors++ == 0) firstError = text;
+}
+
+uint32_t now(void) {
+  using namespace std::chrono;
+  static const steady_clock::time_point start = steady_clock::now();
+  return (uint32_t)duration_cast<microseconds>(steady_clock::now() - start).count() + skew;
+}
+
+// The DMA "interrupt": finish every transfer whose time is up
+void completeDue(uint32_t t) {
+  std::lock_guard<std::recursive_mutex> lock(bus());
+  for (int i = 0; i < INTERFACES; i++) {
+    Transfer &x = transfers[i];
+    if (x.active && (int32_t)(t - x.doneAt) >= 0) {
+      x.active = false;
+      if (memcmp(x.buffer, x.sent.data(), x.sent.size()) != 0) {
+        fail("SPI%d buffer changed while its frame was on the wire", i);
+      }
+      if (x.callback) {
+        // the model may get here late (after hostSpiAdvanceMicros(), or a
+        // sleeping DMA thread), the interrupt on the device would not
+        inCallback = true;
+        callbackAt = x.doneAt;
+        x.callback();
+        inCallback = false;
+      }
+    }
+  }
+}
+
+// Completes transfers on time even while the library spins on its busy
+// flag without calling micros(), as waitShow() does
+void dmaThread(void) {
+  while (true) {
+    std::this_thread::sleep_for(std::chrono::microseconds(20));
+    completeDue(now());
+  }
+}
+
+bool transferActive(int spi) {
+  std::lock_guard<std::recursive_mutex> lock(bus());
+  return transfers[spi].active;
+}
+
+void startDma(void) {
+  static std::once_flag started;
+  std::call_once(started, [] { std::thread(dmaThread).detach(); });
+}
+
+} // namespace
+
+uint32_t micros(void) {
+  if (inCallback) return callbackAt;
+  uint32_t t = now();
+  completeDue(t);
+  return t;
+}
+
+uint32_t millis(void) {
+  return micros() / 1000;
+}
+
+void hostSpiAdvanceMicros(uint32_t us) {
+  skew += us;
+  micros(); // transfers due by now complete straight away
+}
+
+const std::vector<HostSpiFrame> &hostSpiFrames(void) {
+  return frames;
+}
+
+void hostSpiClearFrames(void) {
+  frames.clear();
+}
+
+bool hostSpiTransactionHeld(int interface) {
+  return transactionDepth[interface] > 0;
+}
+
+int hostSpiErrors(void) {
+  return errors;
+}
+
+const std::string &hostSpiFirstError(void) {
+  return firstError;
+}
+
+int hal_spi_begin_ext(int spi, int, pin_t, hal_spi_config_t *config) {
+  if (!config || !(config->flags & HAL_SPI_CONFIG_FLAG_MOSI_ONLY)) {
+    fail("SPI%d not configured MOSI only", spi);
+  }
+  return 0;
+}
+
+void SPIClass::begin(pin_t) {
+}
+
+void SPIClass::setClockSpeed(unsigned clock) {
+  clocks[spi] = clock;
+}
+
+int32_t SPIClass::beginTransaction(void) {
+  transactionDepth[spi]++;
+  return 0;
+}
+
+void SPIClass::endTransaction(void) {
+  if (transactionDepth[spi] == 0) {
+    fail("SPI%d endTransaction() without beginTransaction()", spi);
+    return;
+  }
+  transactionDepth[spi]--;
+}
+
+void SPIClass::transfer(const void *tx, void *, size_t length,
+                        wiring_spi_dma_transfercomplete_callback_t callback) {
+  startDma();
+  uint32_t t = micros();
+  std::unique_lock<std::recursive_mutex> lock(bus());
+  Transfer &x = transfers[spi];
+  if (x.active) {
+    fail("SPI%d transfer started while the previous frame was still on the wire", spi);
+  }
+  if (transactionDepth[spi] == 0) {
+    fail("SPI%d transfer started outside a transaction", spi);
+  }
+  if (clocks[spi] == 0) {
+    fail("SPI%d transfer started before the clock was set", spi);
+    clocks[spi] = 1;
+  }
+
+  const uint8_t *bytes = (const uint8_t *)tx;
+  uint32_t doneAt = t + (uint32_t)((uint64_t)length * 8 * 1000000 / clocks[spi]) + 1;
+  frames.push_back({ spi, clocks[spi], std::vector<uint8_t>(bytes, bytes + length), t, doneAt });
+  x.active = true;
+  x.buffer = bytes;
+  x.sent = frames.back().bytes;
+  x.doneAt = doneAt;
+  x.callback = callback;
+  lock.unlock();
+  if (!callback) {
+    do {
+      micros();
+    } while (transferActive(spi)); // blocking transfer
+  }
+}
+
+void Logger::error(const char *format, ...) const {
+  va_list args;
+  va_start(args, format);
+  fprintf(stderr, "neopixel: ");
+  vfprintf(stderr, format, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+}
+
+bool hostDecodeFrame(const HostSpiFrame &frame, uint8_t bitsPerBit, const HostPixelTiming &timing,
+                     std::vector<uint8_t> &pixelBytes, std::string &error) {
+  char text[160];
+  size_t totalBits = frame.bytes.size() * 8;
+  auto bit = [&](size_t i) { return (frame.bytes[i / 8] >> (7 - i % 8)) & 1; };
+  uint32_t bitNs = (uint32_t)(bitsPerBit * 1000000000ULL / frame.clock);
+  if (bitNs < timing.bitMin || bitNs > timing.bitMax) {
+    snprintf(text, sizeof(text), "bit period %u ns out of range at %u Hz", bitNs, frame.clock);
+    error = text;
+    return false;
+  }
+
+  pixelBytes.clear();
+  size_t i = 0;
+  uint8_t value = 0;
+  int bits = 0;
+  while (i + bitsPerBit <= totalBits && bit(i)) {
+    uint8_t ones = 0;
+    while (ones < bitsPerBit && bit(i + ones)) ones++;
+    for (uint8_t k = ones; k < bitsPerBit; k++) {
+      if (bit(i + k)) {
+        snprintf(text, sizeof(text), "cell at SPI bit %zu has a second HIGH pulse", i);
+        error = text;
+        return false;
+      }
+    }
+    if (ones == bitsPerBit) {
+      snprintf(text, sizeof(text), "cell at SPI bit %zu never goes LOW", i);
+      error = text;
+      return false;
+    }
+    uint32_t highNs = (uint32_t)(ones * 1000000000ULL / frame.clock);
+    bool one;
+    if (highNs >= timing.t1hMin && highNs <= timing.t1hMax) {
+      one = true;
+    } else if (highNs >= timing.t0hMin && highNs <= timing.t0hMax) {
+      one = false;
+    } else {
+      snprintf(text, sizeof(text), "HIGH pulse of %u ns at SPI bit %zu is neither T0H nor T1H", highNs, i);
+      error = text;
+      return false;
+    }
+    value = (value << 1) | one;
+    if (++bits == 8) {
+      pixelBytes.push_back(value);
+      bits = 0;
+    }
+    i += bitsPerBit;
+  }
+
+  if (bits) {
+    snprintf(text, sizeof(text), "frame ends %d bits into a byte", bits);
+    error = text;
+    return false;
+  }
+  for (; i < totalBits; i++) {
+    if (bit(i)) {
+      snprintf(text, sizeof(text), "line goes HIGH at SPI bit %zu after the pixel data", i);
+      error = text;
+      return false;
+    }
+  }
+  return true;
+}
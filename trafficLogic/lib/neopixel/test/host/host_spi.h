@@ -0,0 +1,57 @@
+// Host model of the P2 SPI DMA output and a WS2812 waveform decoder.
+//
+// Every SPIClass::transfer() is recorded as a frame together with the SPI
+// clock it was sent at.  The transfer stays "on the wire" for as long as
+// the real one would, then the DMA completion callback fires from inside
+// micros(), much as the interrupt would on the device.  While a frame is
+// in flight its buffer must not change; that and other misuse of the bus
+// is counted in hostSpiErrors().
+
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct HostSpiFrame {
+  int interface;
+  uint32_t clock;              // SPI clock in Hz when the transfer started
+  std::vector<uint8_t> bytes;  // what went out on MOSI
+  uint32_t startMicros;        // micros() when the transfer started...
+  uint32_t endMicros;          // ...and when its last bit was shifted out
+};
+
+// Frames sent since the last hostSpiClearFrames()
+const std::vector<HostSpiFrame> &hostSpiFrames(void);
+void hostSpiClearFrames(void);
+
+// Move the clock forward without waiting, e.g. to skip the wire time when
+// measuring encode speed.  Transfers due by then complete before it returns.
+void hostSpiAdvanceMicros(uint32_t us);
+
+// True while 'interface' holds the SPI transaction lock
+bool hostSpiTransactionHeld(int interface);
+
+// Problems seen on the bus so far, with a description of the first one
+int hostSpiErrors(void);
+const std::string &hostSpiFirstError(void);
+
+// Pulse limits for one kind of pixel, in ns
+struct HostPixelTiming {
+  uint32_t t0hMin, t0hMax; // HIGH time of a '0'
+  uint32_t t1hMin, t1hMax; // HIGH time of a '1'
+  uint32_t bitMin, bitMax; // length of one bit
+};
+
+extern const HostPixelTiming hostWs2812Timing, hostWs2811Timing;
+
+// Decode a frame back into the pixel bytes it carries.  Every neopixel bit
+// is 'bitsPerBit' SPI bits; each must be one HIGH pulse followed by LOW,
+// with the pulse and bit lengths at the frame's clock inside 'timing'.
+// Anything after the pixel data must be LOW.  Returns false and sets
+// 'error' on the first violation.
+bool hostDecodeFrame(const HostSpiFrame &frame, uint8_t bitsPerBit, const HostPixelTiming &timing,
+                     std::vector<uint8_t> &pixelBytes, std::string &error);
+
+#endif // HOST_SPI_H
@@ -0,0 +1,38 @@
+/*
+ * Project trafficLogic
+ * Animation clips, generated by tools/makeClips.py from clips/rushHourWarning.clip, clips/arrivalCelebration.clip
+ * Do not edit, change the sources and run the tool again
+ */
+
+#ifndef CLIPS_H
+#define CLIPS_H
+
+#include "pixelClip.h"
+
+// rushHourWarning: 5 frames of 48 pixels, 44 bytes (720 uncompressed)
+const uint32_t rushHourWarningPalette[] = {0x000000, 0xFF0000, 0xFFA000};
+const uint8_t rushHourWarningData[] = {
+  0x88, 0x01, 0x81, 0x00, 0x81, 0x02, 0x81, 0x00, 0x81, 0x01, 0x81, 0x00, 0x81, 0x02, 0x81, 0x00,
+  0x81, 0x01, 0x85, 0x00, 0x81, 0x01, 0x81, 0x00, 0x81, 0x02, 0x81, 0x00, 0x88, 0x01, 0x2F, 0x2F,
+  0x8A, 0x00, 0x03, 0x83, 0x00, 0x03, 0x8B, 0x00, 0x03, 0x88, 0x00, 0x2F,
+};
+const PixelClip rushHourWarning = {rushHourWarningPalette, 3, 48, 5, 150, rushHourWarningData};
+
+// arrivalCelebration: 11 frames of 48 pixels, 168 bytes (1584 uncompressed)
+const uint32_t arrivalCelebrationPalette[] = {0x000000, 0xFFFFFF, 0xFFD000, 0xFF00C0, 0x00E0FF, 0x00FF40};
+const uint8_t arrivalCelebrationData[] = {
+  0x92, 0x00, 0x81, 0x01, 0x85, 0x00, 0x81, 0x01, 0x92, 0x00, 0x09, 0x83, 0x02, 0x03, 0x80, 0x02,
+  0x81, 0x00, 0x80, 0x02, 0x03, 0x80, 0x02, 0x81, 0x00, 0x80, 0x02, 0x03, 0x83, 0x02, 0x09, 0x00,
+  0x85, 0x03, 0x01, 0x80, 0x03, 0x83, 0x00, 0x80, 0x03, 0x01, 0x80, 0x03, 0x83, 0x00, 0x80, 0x03,
+  0x01, 0x80, 0x03, 0x83, 0x00, 0x80, 0x03, 0x01, 0x80, 0x03, 0x83, 0x00, 0x80, 0x03, 0x01, 0x85,
+  0x03, 0x00, 0x88, 0x04, 0x85, 0x00, 0x81, 0x04, 0x85, 0x00, 0x81, 0x04, 0x85, 0x00, 0x81, 0x04,
+  0x85, 0x00, 0x88, 0x04, 0x80, 0x05, 0x85, 0x00, 0x80, 0x05, 0x82, 0x00, 0x80, 0x05, 0x02, 0x81,
+  0x00, 0x80, 0x05, 0x03, 0x80, 0x05, 0x84, 0x00, 0x80, 0x05, 0x01, 0x82, 0x00, 0x80, 0x05, 0x02,
+  0x80, 0x05, 0x80, 0x00, 0x80, 0x05, 0x81, 0x00, 0x80, 0x05, 0x82, 0x00, 0x80, 0x05, 0x2F, 0x87,
+  0x00, 0x80, 0x05, 0x05, 0x80, 0x05, 0x00, 0x82, 0x00, 0x80, 0x05, 0x00, 0x82, 0x00, 0x80, 0x05,
+  0x01, 0x82, 0x00, 0x80, 0x05, 0x01, 0x80, 0x00, 0x80, 0x05, 0x00, 0x80, 0x05, 0x81, 0x00, 0x02,
+  0x84, 0x00, 0x2F, 0x07, 0xA7, 0x00, 0x2F, 0x2F,
+};
+const PixelClip arrivalCelebration = {arrivalCelebrationPalette, 6, 48, 11, 120, arrivalCelebrationData};
+
+#endif // CLIPS_H
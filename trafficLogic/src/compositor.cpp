@@ -0,0 +1,92 @@
+/*
+ * Project trafficLogic
+ * Split one strip into segments, each with its own effect and frame rate
+ */
+
+#include "compositor.h"
+
+int Compositor::add(uint16_t first, uint16_t count, Effect *effect, uint16_t frameMs)
+{
+  if (segmentCount >= COMPOSITOR_MAX_SEGMENTS)
+  {
+    return -1;
+  }
+  uint8_t segment = segmentCount++;
+  segments[segment] = {first, count, effect, frameMs, 0};
+  order[segment] = segment;
+  return segment;
+}
+
+void Compositor::setEffect(int segment, Effect *effect, uint32_t now)
+{
+  if (segment < 0 || segment >= segmentCount)
+  {
+    return;
+  }
+  segments[segment].effect = effect;
+  segments[segment].due = now;
+  if (effect)
+  {
+    effect->start(now);
+  }
+  reschedule(segment);
+}
+
+void Compositor::start(uint32_t now)
+{
+  for (uint8_t i = 0; i < segmentCount; i++)
+  {
+    segments[i].due = now;
+    order[i] = i;
+    if (segments[i].effect)
+    {
+      segments[i].effect->start(now);
+    }
+  }
+}
+
+bool Compositor::render(uint32_t now)
+{
+  bool changed = false;
+  while (segmentCount && (int32_t)(now - segments[order[0]].due) >= 0)
+  {
+    uint8_t segment = order[0];
+    Segment &s = segments[segment];
+    if (s.effect && s.effect->render(strip, s.first, s.count, now))
+    {
+      changed = true;
+    }
+
+    // keep the segment's cadence, unless it fell a whole frame behind
+    s.due += s.frameMs ? s.frameMs : 1;
+    if ((int32_t)(now - s.due) >= 0)
+    {
+      s.due = now + (s.frameMs ? s.frameMs : 1);
+    }
+    reschedule(segment);
+  }
+  return changed;
+}
+
+// move 'segment' to its place in 'order' after its due time changed
+void Compositor::reschedule(uint8_t segment)
+{
+  uint8_t i = 0;
+  while (order[i] != segment)
+  {
+    i++;
+  }
+  // later than the next one: move toward the back
+  while (i + 1 < segmentCount && (int32_t)(segments[order[i + 1]].due - segments[segment].due) <= 0)
+  {
+    order[i] = order[i + 1];
+    i++;
+  }
+  // earlier than the one before: move toward the front
+  while (i > 0 && (int32_t)(segments[segment].due - segments[order[i - 1]].due) < 0)
+  {
+    order[i] = order[i - 1];
+    i--;
+  }
+  order[i] = segment;
+}
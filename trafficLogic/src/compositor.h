@@ -0,0 +1,56 @@
+/*
+ * Project trafficLogic
+ * Split one strip into segments, each with its own effect and frame rate
+ *
+ * Each segment is a range of the strip drawn by one effect, at most once
+ * every frameMs. render() draws the segments that are due into the shared
+ * buffer and the caller commits the strip once afterwards. Segments are
+ * kept in order of when they are next due, so a tick where nothing is due
+ * costs one compare and a busy tick costs only the segments it draws,
+ * however many segments there are.
+ */
+
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include "effects.h"
+
+#define COMPOSITOR_MAX_SEGMENTS 8
+
+class Compositor
+{
+public:
+  explicit Compositor(Adafruit_NeoPixel &strip) : strip(strip) {}
+
+  // add a segment of 'count' pixels from 'first', drawn by 'effect' every
+  // 'frameMs' (0 = every render), returns its number or -1 when full
+  int add(uint16_t first, uint16_t count, Effect *effect, uint16_t frameMs = 0);
+
+  // change a segment's effect, it restarts and is drawn on the next render
+  void setEffect(int segment, Effect *effect, uint32_t now);
+
+  // restart every segment's effect
+  void start(uint32_t now);
+
+  // draw every segment that is due at 'now', returns true if any pixel was written
+  bool render(uint32_t now);
+
+private:
+  struct Segment
+  {
+    uint16_t first;
+    uint16_t count;
+    Effect *effect;
+    uint16_t frameMs;
+    uint32_t due; // next time the segment is drawn
+  };
+
+  void reschedule(uint8_t segment);
+
+  Adafruit_NeoPixel &strip;
+  Segment segments[COMPOSITOR_MAX_SEGMENTS];
+  uint8_t order[COMPOSITOR_MAX_SEGMENTS]; // segment numbers, soonest due first
+  uint8_t segmentCount = 0;
+};
+
+#endif // COMPOSITOR_H
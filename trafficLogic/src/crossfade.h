@@ -0,0 +1,110 @@
+/*
+ * Project trafficLogic
+ * Crossfade between what the strip showed and a newly started effect
+ *
+ * start() takes a copy of the strip as the frame to fade from. Each frame
+ * after that the new effect draws as usual between beginFrame() and
+ * endFrame(): beginFrame() puts its own undimmed frame (the target) back
+ * into the strip so incremental effects keep drawing on top of their last
+ * frame, and endFrame() keeps what was drawn as the new target and writes
+ * the blend of the two frames into the strip. The blend is one fixed-point
+ * lerp per byte over the whole buffer, no floating point, and the caller
+ * still commits the strip once per frame.
+ */
+
+#ifndef CROSSFADE_H
+#define CROSSFADE_H
+
+#include "Particle.h"
+#include "neopixel.h"
+
+// PIXELS and BYTES_PER_PIXEL must match the strip (3 for RGB, 4 for RGBW);
+// a strip that doesn't, or one in palette mode, is never faded
+template <uint16_t PIXELS, uint8_t BYTES_PER_PIXEL = 3>
+class Crossfade
+{
+  static const uint16_t BYTES = PIXELS * BYTES_PER_PIXEL;
+
+public:
+  explicit Crossfade(Adafruit_NeoPixel &strip) : strip(strip) {}
+
+  // fade from what is in the strip now to whatever is drawn next, over 'durationMs'
+  // starting again while a fade is running fades on from the current blend
+  // returns false, and the caller switches straight over, if the strip can't be faded
+  bool start(uint32_t now, uint16_t durationMs)
+  {
+    if (!fits() || durationMs == 0)
+    {
+      fading = false;
+      return false;
+    }
+    memcpy(fromFrame, strip.getPixels(), BYTES);
+    memcpy(targetFrame, fromFrame, BYTES);
+    startTime = now;
+    duration = durationMs;
+    fading = true;
+    return true;
+  }
+
+  bool active() const { return fading; }
+
+  // call before drawing a frame
+  void beginFrame()
+  {
+    if (fading && fits())
+    {
+      strip.writeRaw(0, targetFrame, BYTES);
+    }
+  }
+
+  // call after drawing a frame, returns true if the strip was changed
+  bool endFrame(uint32_t now)
+  {
+    if (!fading)
+    {
+      return false;
+    }
+    if (!fits())
+    {
+      fading = false; // the strip changed layout mid fade, leave it as drawn
+      return false;
+    }
+    uint8_t *pixels = strip.getPixels();
+    memcpy(targetFrame, pixels, BYTES);
+
+    uint32_t elapsed = now - startTime;
+    if (elapsed >= duration)
+    {
+      fading = false; // the strip already holds the target
+      return true;
+    }
+
+    // weight of the target in 1/256ths, 0 at the start and 256 at the end
+    uint16_t weight = (elapsed << 8) / duration;
+    uint16_t fromWeight = 256 - weight;
+    for (uint16_t i = 0; i < BYTES; i++)
+    {
+      pixels[i] = (fromFrame[i] * fromWeight + targetFrame[i] * weight) >> 8;
+    }
+    strip.markDirty(0, PIXELS);
+    return true;
+  }
+
+private:
+  // the strip's buffer holds exactly BYTES of colors: the right length, the
+  // right bytes per pixel and not palette indexes
+  bool fits() const
+  {
+    return strip.numPixels() == PIXELS && !strip.isPaletteMode() &&
+           neoPixelLayout(strip.getType()).bytesPerPixel == BYTES_PER_PIXEL;
+  }
+
+  Adafruit_NeoPixel &strip;
+  uint8_t fromFrame[BYTES];   // strip contents when the fade started
+  uint8_t targetFrame[BYTES]; // latest frame drawn by the new effect
+  uint32_t startTime = 0;
+  uint16_t duration = 0;
+  bool fading = false;
+};
+
+#endif // CROSSFADE_H
@@ -0,0 +1,173 @@
+/*
+ * Project trafficLogic
+ * Time-driven pixel effects for the render thread
+ */
+
+#include "effects.h"
+
+uint32_t HueBand::pick() const
+{
+  uint16_t pixelHue = hue - spread + random(2 * (uint32_t)spread + 1); // hue math wraps, so red can drift either side of 0
+  return Adafruit_NeoPixel::ColorHSV(pixelHue, random(204, 256), 255);
+}
+
+void WipeEffect::start(uint32_t now)
+{
+  Effect::start(now);
+  stepsDone = 0;
+}
+
+bool WipeEffect::render(Adafruit_NeoPixel &strip, uint16_t first, uint16_t count, uint32_t now)
+{
+  if (count == 0)
+  {
+    return false;
+  }
+  uint32_t steps = (now - startTime) / stepMs + 1; // the first pixel is painted straight away
+  if (steps - stepsDone > count)
+  {
+    stepsDone = steps - count; // more than a whole pass behind, only the last pass is visible
+  }
+
+  bool changed = false;
+  while (stepsDone < steps)
+  {
+    uint16_t position = stepsDone % count;
+    if (position == 0)
+    {
+      passColor = band.pick();
+    }
+    strip.setPixelColor(first + position, colorPerPass ? passColor : band.pick());
+    stepsDone++;
+    changed = true;
+  }
+  return changed;
+}
+
+void ChaseEffect::start(uint32_t now)
+{
+  Effect::start(now);
+  position = -1;
+}
+
+bool ChaseEffect::render(Adafruit_NeoPixel &strip, uint16_t first, uint16_t count, uint32_t now)
+{
+  if (count == 0)
+  {
+    return false;
+  }
+  int32_t newPosition = ((now - startTime) / stepMs) % count;
+  if (newPosition == position)
+  {
+    return false;
+  }
+
+  uint16_t blockLength = length < count ? length : count;
+  if (position < 0)
+  {
+    strip.fill(0, first, count); // first frame: start from a dark range
+  }
+  else
+  {
+    for (uint16_t i = 0; i < blockLength; i++)
+    {
+      strip.setPixelColor(first + (position + i) % count, 0);
+    }
+  }
+  for (uint16_t i = 0; i < blockLength; i++)
+  {
+    strip.setPixelColor(first + (newPosition + i) % count, band.pick());
+  }
+  position = newPosition;
+  return true;
+}
+
+void BreatheEffect::start(uint32_t now)
+{
+  Effect::start(now);
+  level = -1;
+}
+
+bool BreatheEffect::render(Adafruit_NeoPixel &strip, uint16_t first, uint16_t count, uint32_t now)
+{
+  if (count == 0)
+  {
+    return false;
+  }
+  // triangle wave: up for the first half of the period, down for the second
+  // gamma on the strip turns the linear ramp into an even looking fade
+  uint32_t phase = (now - startTime) % periodMs;
+  uint32_t half = periodMs / 2;
+  uint32_t ramp = phase < half ? phase : periodMs - phase;
+  int16_t newLevel = minValue + (255 - minValue) * ramp / (half ? half : 1);
+  if (newLevel == level)
+  {
+    return false;
+  }
+
+  strip.fill(Adafruit_NeoPixel::ColorHSV(band.hue, 255, newLevel), first, count);
+  level = newLevel;
+  return true;
+}
+
+void SparkleEffect::start(uint32_t now)
+{
+  Effect::start(now);
+  stepsDone = 0;
+  cleared = false;
+}
+
+bool SparkleEffect::render(Adafruit_NeoPixel &strip, uint16_t first, uint16_t count, uint32_t now)
+{
+  if (count == 0)
+  {
+    return false;
+  }
+  bool changed = false;
+  if (!cleared)
+  {
+    strip.fill(0, first, count); // first frame: start from a dark range
+    cleared = true;
+    changed = true;
+  }
+
+  uint32_t steps = (now - startTime) / stepMs;
+  if (steps != stepsDone) // missed steps are not caught up, sparkles are random anyway
+  {
+    for (uint8_t i = 0; i < perStep; i++)
+    {
+      strip.setPixelColor(first + random(count), 0);
+      strip.setPixelColor(first + random(count), band.pick());
+    }
+    stepsDone = steps;
+    changed = true;
+  }
+  return changed;
+}
+
+void LevelEffect::start(uint32_t now)
+{
+  Effect::start(now);
+  litDrawn = -1;
+}
+
+bool LevelEffect::render(Adafruit_NeoPixel &strip, uint16_t first, uint16_t count, uint32_t)
+{
+  int32_t lit = (level * count + 127) / 255;
+  if (count == 0 || lit == litDrawn)
+  {
+    return false;
+  }
+
+  uint16_t hue = emptyHue + ((int32_t)(int16_t)(fullHue - emptyHue) * level) / 255; // shortest way round the wheel
+  if (lit > 0)
+  {
+    strip.fill(Adafruit_NeoPixel::ColorHSV(hue), first, lit);
+  }
+  if (lit < count)
+  {
+    strip.fill(0, first + lit, count - lit);
+  }
+  litDrawn = lit;
+  return true;
+}
@@ -0,0 +1,141 @@
+/*
+ * Project trafficLogic
+ * Time-driven pixel effects for the render thread
+ *
+ * An effect draws into a range of the strip (first, count) from the time it
+ * is given, so a frame can be late or skipped without the animation changing
+ * speed. render() is called once per frame and never blocks or calls show(),
+ * the caller commits the strip after rendering. Each effect lists how many
+ * pixels it writes per frame so the frame cost is known up front.
+ */
+
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include "Particle.h"
+#include "neopixel.h"
+
+// a range of colors on the 0-65535 hue wheel
+struct HueBand
+{
+  uint16_t hue;    // center of the band
+  uint16_t spread; // how far a color may drift either side of 'hue', 0x8000 = the whole wheel
+
+  // random color inside the band, up to 20% washed toward white
+  uint32_t pick() const;
+};
+
+class Effect
+{
+public:
+  virtual ~Effect() {}
+
+  // restart from the first frame, 'now' in milliseconds
+  // also needed after the effect is moved to a different range
+  virtual void start(uint32_t now) { startTime = now; }
+
+  // draw the frame for time 'now' into 'count' pixels starting at 'first'
+  // returns true if any pixel was written
+  virtual bool render(Adafruit_NeoPixel &strip, uint16_t first, uint16_t count, uint32_t now) = 0;
+
+protected:
+  uint32_t startTime = 0;
+};
+
+// paints the range one pixel per step, then starts over from the first pixel
+// writes one pixel per step, at most 'count' if frames were missed
+class WipeEffect : public Effect
+{
+public:
+  // colorPerPass picks one color for each pass instead of one per pixel
+  WipeEffect(HueBand band, uint16_t stepMs, bool colorPerPass = false)
+      : band(band), stepMs(stepMs), colorPerPass(colorPerPass) {}
+
+  void start(uint32_t now) override;
+  bool render(Adafruit_NeoPixel &strip, uint16_t first, uint16_t count, uint32_t now) override;
+
+private:
+  HueBand band;
+  uint16_t stepMs;
+  bool colorPerPass;
+  uint32_t stepsDone = 0;
+  uint32_t passColor = 0;
+};
+
+// a block of 'length' lit pixels running round the range over black
+// writes 2 * length pixels per step, the whole range on the first frame
+class ChaseEffect : public Effect
+{
+public:
+  ChaseEffect(HueBand band, uint16_t stepMs, uint8_t length)
+      : band(band), stepMs(stepMs), length(length) {}
+
+  void start(uint32_t now) override;
+  bool render(Adafruit_NeoPixel &strip, uint16_t first, uint16_t count, uint32_t now) override;
+
+private:
+  HueBand band;
+  uint16_t stepMs;
+  uint8_t length;
+  int32_t position = -1; // first pixel of the lit block, -1 before the first frame
+};
+
+// the whole range fades between minValue and full and back once per period
+// writes the whole range (one fill) on frames where the level changes
+class BreatheEffect : public Effect
+{
+public:
+  BreatheEffect(HueBand band, uint16_t periodMs, uint8_t minValue)
+      : band(band), periodMs(periodMs), minValue(minValue) {}
+
+  void start(uint32_t now) override;
+  bool render(Adafruit_NeoPixel &strip, uint16_t first, uint16_t count, uint32_t now) override;
+
+private:
+  HueBand band;
+  uint16_t periodMs;
+  uint8_t minValue;
+  int16_t level = -1; // value last drawn, -1 before the first frame
+};
+
+// each step lights 'perStep' random pixels and turns as many others off
+// writes 2 * perStep pixels per step, the whole range on the first frame
+class SparkleEffect : public Effect
+{
+public:
+  SparkleEffect(HueBand band, uint16_t stepMs, uint8_t perStep)
+      : band(band), stepMs(stepMs), perStep(perStep) {}
+
+  void start(uint32_t now) override;
+  bool render(Adafruit_NeoPixel &strip, uint16_t first, uint16_t count, uint32_t now) override;
+
+private:
+  HueBand band;
+  uint16_t stepMs;
+  uint8_t perStep;
+  uint32_t stepsDone = 0;
+  bool cleared = false;
+};
+
+// lights the start of the range in proportion to a level and leaves the rest dark,
+// the color moves from emptyHue toward fullHue as the level rises
+// writes the whole range when the number of lit pixels changes, nothing otherwise
+class LevelEffect : public Effect
+{
+public:
+  LevelEffect(uint16_t emptyHue, uint16_t fullHue) : emptyHue(emptyHue), fullHue(fullHue) {}
+
+  // 0 = nothing lit, 255 = the whole range, drawn on the next render()
+  void setLevel(uint8_t newLevel) { level = newLevel; }
+
+  void start(uint32_t now) override;
+  bool render(Adafruit_NeoPixel &strip, uint16_t first, uint16_t count, uint32_t now) override;
+
+private:
+  uint16_t emptyHue;
+  uint16_t fullHue;
+  uint8_t level = 0;
+  int32_t litDrawn = -1; // pixels lit on the last frame, -1 before the first frame
+};
+
+#endif // EFFECTS_H
@@ -0,0 +1,55 @@
+/*
+ * Project trafficLogic
+ * Single-producer single-consumer queue for handing work to the render thread
+ *
+ * push() is only ever called from one thread and pop() from one other thread.
+ * Neither blocks or takes a lock, so the render thread never waits on loop()
+ * or the cloud, and loop() never waits on the strip.
+ */
+
+#ifndef FRAME_QUEUE_H
+#define FRAME_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T, size_t SIZE>
+class FrameQueue
+{
+  static_assert(SIZE >= 2 && (SIZE & (SIZE - 1)) == 0, "queue size must be a power of two");
+
+public:
+  // producer side: copy item in, false if the queue is full
+  bool push(const T &item)
+  {
+    uint32_t writeIndex = head.load(std::memory_order_relaxed);
+    if (writeIndex - tail.load(std::memory_order_acquire) == SIZE)
+    {
+      return false;
+    }
+    items[writeIndex & (SIZE - 1)] = item;
+    head.store(writeIndex + 1, std::memory_order_release); // publish the item to the consumer
+    return true;
+  }
+
+  // consumer side: copy the oldest item out, false if the queue is empty
+  bool pop(T &item)
+  {
+    uint32_t readIndex = tail.load(std::memory_order_relaxed);
+    if (head.load(std::memory_order_acquire) == readIndex)
+    {
+      return false;
+    }
+    item = items[readIndex & (SIZE - 1)];
+    tail.store(readIndex + 1, std::memory_order_release); // hand the slot back to the producer
+    return true;
+  }
+
+private:
+  T items[SIZE];
+  std::atomic<uint32_t> head{0}; // next slot to write, only changed by push()
+  std::atomic<uint32_t> tail{0}; // next slot to read, only changed by pop()
+};
+
+#endif // FRAME_QUEUE_H
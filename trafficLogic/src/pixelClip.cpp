@@ -0,0 +1,64 @@
+/*
+ * Project trafficLogic
+ * Animation clips stored in flash and played back as an effect
+ */
+
+#include "pixelClip.h"
+
+void ClipEffect::start(uint32_t now)
+{
+  Effect::start(now);
+  framesDone = 0;
+  offset = 0;
+}
+
+bool ClipEffect::render(Adafruit_NeoPixel &strip, uint16_t first, uint16_t count, uint32_t now)
+{
+  if (clip.frameCount == 0)
+  {
+    return false;
+  }
+  uint32_t target = (now - startTime) / clip.frameMs; // frame that should be showing
+  if (!loop && target >= clip.frameCount)
+  {
+    target = clip.frameCount - 1;
+  }
+  if (framesDone > target)
+  {
+    return false; // still showing the right frame
+  }
+  if (target - framesDone >= clip.frameCount)
+  {
+    framesDone = target - target % clip.frameCount; // a whole clip behind, restart from the current loop's frame 0
+  }
+
+  while (framesDone <= target)
+  {
+    if (framesDone % clip.frameCount == 0)
+    {
+      offset = 0;
+    }
+    decodeFrame(strip, first, count);
+    framesDone++;
+  }
+  return true;
+}
+
+void ClipEffect::decodeFrame(Adafruit_NeoPixel &strip, uint16_t first, uint16_t count)
+{
+  uint16_t n = 0;
+  while (n < clip.pixels)
+  {
+    uint8_t run = clip.data[offset++];
+    uint16_t length = (run & 0x7F) + 1;
+    if (run & 0x80)
+    {
+      uint8_t index = clip.data[offset++];
+      if (n < count && index < clip.paletteSize)
+      {
+        strip.fill(clip.palette[index], first + n, length < count - n ? length : count - n);
+      }
+    }
+    n += length;
+  }
+}
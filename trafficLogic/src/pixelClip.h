@@ -0,0 +1,54 @@
+/*
+ * Project trafficLogic
+ * Animation clips stored in flash and played back as an effect
+ *
+ * A clip is a palette and a run-length coded byte stream, built on the
+ * host by tools/makeClips.py from the sources in clips/ into clips.h. Both
+ * are const so they stay in flash; playback needs a few bytes of state and
+ * no frame buffer of its own.
+ *
+ * Each frame is a list of runs that together cover the clip's pixels:
+ *
+ *   0x00-0x7F        skip (n + 1) pixels, unchanged since the last frame
+ *   0x80-0xFF index  (n - 0x7F) pixels of palette color 'index'
+ *
+ * Frame 0 has no skips, so playback can always start or loop from it.
+ */
+
+#ifndef PIXEL_CLIP_H
+#define PIXEL_CLIP_H
+
+#include "effects.h"
+
+struct PixelClip
+{
+  const uint32_t *palette; // packed RGB colors
+  uint16_t paletteSize;
+  uint16_t pixels;     // pixels per frame, in strip order
+  uint16_t frameCount;
+  uint16_t frameMs;    // how long each frame is shown
+  const uint8_t *data; // frames, back to back
+};
+
+// plays a clip into the range, one frame per frameMs, decoding straight into
+// the strip with fill() so only runs that changed are written
+// decodes every frame that is due, at most a whole clip if frames were missed
+class ClipEffect : public Effect
+{
+public:
+  // a clip that doesn't loop holds its last frame
+  explicit ClipEffect(const PixelClip &clip, bool loop = true) : clip(clip), loop(loop) {}
+
+  void start(uint32_t now) override;
+  bool render(Adafruit_NeoPixel &strip, uint16_t first, uint16_t count, uint32_t now) override;
+
+private:
+  void decodeFrame(Adafruit_NeoPixel &strip, uint16_t first, uint16_t count);
+
+  const PixelClip &clip;
+  bool loop;
+  uint32_t framesDone = 0; // frames decoded since start()
+  uint32_t offset = 0;     // where the next frame starts in clip.data
+};
+
+#endif // PIXEL_CLIP_H
@@ -0,0 +1,189 @@
+/*
+ * Project trafficLogic
+ * XY addressing for a strip wired as a matrix panel
+ *
+ * The (x, y) -> strip index table for a panel is built at compile time from
+ * its size, wiring and rotation, so drawing is one table load per pixel with
+ * no coordinate math. x runs left to right and y top to bottom as the panel
+ * is viewed. Coordinates outside the panel are ignored, like indexes past
+ * the end of the strip.
+ */
+
+#ifndef PIXEL_MATRIX_H
+#define PIXEL_MATRIX_H
+
+#include "neopixel.h"
+
+// how the strip runs through the panel, seen from the front with pixel 0 top left
+enum class MatrixLayout
+{
+  PROGRESSIVE, // every row runs left to right
+  SERPENTINE   // rows alternate left to right, right to left
+};
+
+// clockwise rotation of the drawing relative to the physical panel
+enum class MatrixRotation
+{
+  ROTATE_0,
+  ROTATE_90,
+  ROTATE_180,
+  ROTATE_270
+};
+
+// WIDTH and HEIGHT are the physical panel, before rotation
+template <uint8_t WIDTH, uint8_t HEIGHT,
+          MatrixLayout LAYOUT = MatrixLayout::PROGRESSIVE,
+          MatrixRotation ROTATION = MatrixRotation::ROTATE_0>
+class PixelMatrix
+{
+  static constexpr bool SWAPPED = ROTATION == MatrixRotation::ROTATE_90 || ROTATION == MatrixRotation::ROTATE_270;
+
+public:
+  // drawing size after rotation
+  static constexpr uint8_t width = SWAPPED ? HEIGHT : WIDTH;
+  static constexpr uint8_t height = SWAPPED ? WIDTH : HEIGHT;
+  static constexpr uint16_t count = (uint16_t)WIDTH * HEIGHT;
+
+  // strip index of every drawing coordinate, [y][x]
+  struct Lut
+  {
+    uint16_t index[height][width];
+  };
+
+  static constexpr Lut makeLut()
+  {
+    Lut lut = {};
+    for (int y = 0; y < height; y++)
+    {
+      for (int x = 0; x < width; x++)
+      {
+        // drawing coordinate -> physical column and row
+        int column = x, row = y;
+        if (ROTATION == MatrixRotation::ROTATE_90)
+        {
+          column = y;
+          row = HEIGHT - 1 - x;
+        }
+        else if (ROTATION == MatrixRotation::ROTATE_180)
+        {
+          column = WIDTH - 1 - x;
+          row = HEIGHT - 1 - y;
+        }
+        else if (ROTATION == MatrixRotation::ROTATE_270)
+        {
+          column = WIDTH - 1 - y;
+          row = x;
+        }
+        if (LAYOUT == MatrixLayout::SERPENTINE && (row & 1))
+        {
+          column = WIDTH - 1 - column;
+        }
+        lut.index[y][x] = row * WIDTH + column;
+      }
+    }
+    return lut;
+  }
+
+  static constexpr Lut lut = makeLut();
+
+  // 'first' is the strip index of the panel's pixel 0, for panels that are
+  // part of a longer strip
+  explicit PixelMatrix(Adafruit_NeoPixel &strip, uint16_t first = 0) : strip(strip), first(first) {}
+
+  static constexpr uint16_t index(uint8_t x, uint8_t y)
+  {
+    return lut.index[y][x];
+  }
+
+  void setPixel(uint8_t x, uint8_t y, uint32_t color)
+  {
+    if (x < width && y < height)
+    {
+      strip.setPixelColor(first + index(x, y), color);
+    }
+  }
+
+  uint32_t getPixel(uint8_t x, uint8_t y) const
+  {
+    return (x < width && y < height) ? strip.getPixelColor(first + index(x, y)) : 0;
+  }
+
+  // 'length' pixels of row y from column x, 0 runs to the right edge
+  void fillRow(uint8_t y, uint32_t color, uint8_t x = 0, uint8_t length = 0)
+  {
+    if (y >= height || x >= width)
+    {
+      return;
+    }
+    if (length == 0 || length > width - x)
+    {
+      length = width - x;
+    }
+    fillSpan(index(x, y), index(x + length - 1, y), length, color, x, y, 1, 0);
+  }
+
+  // 'length' pixels of column x from row y, 0 runs to the bottom edge
+  void fillColumn(uint8_t x, uint32_t color, uint8_t y = 0, uint8_t length = 0)
+  {
+    if (x >= width || y >= height)
+    {
+      return;
+    }
+    if (length == 0 || length > height - y)
+    {
+      length = height - y;
+    }
+    fillSpan(index(x, y), index(x, y + length - 1), length, color, x, y, 0, 1);
+  }
+
+  // rectangle with top left corner (x, y), clipped to the panel
+  void fillRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint32_t color)
+  {
+    if (x >= width || y >= height || w == 0 || h == 0)
+    {
+      return;
+    }
+    if (w > width - x)
+    {
+      w = width - x;
+    }
+    if (h > height - y)
+    {
+      h = height - y;
+    }
+    for (uint8_t row = y; row < y + h; row++)
+    {
+      fillRow(row, color, x, w);
+    }
+  }
+
+  void fill(uint32_t color)
+  {
+    strip.fill(color, first, count);
+  }
+
+private:
+  // a run along a physical row is contiguous on the strip whatever the
+  // wiring direction, so it is a single strip fill; anything else goes
+  // through the table one pixel at a time
+  void fillSpan(uint16_t start, uint16_t end, uint8_t length, uint32_t color,
+                uint8_t x, uint8_t y, uint8_t dx, uint8_t dy)
+  {
+    uint16_t low = start < end ? start : end;
+    uint16_t high = start < end ? end : start;
+    if (high - low == length - 1)
+    {
+      strip.fill(color, first + low, length);
+      return;
+    }
+    for (uint8_t i = 0; i < length; i++)
+    {
+      strip.setPixelColor(first + index(x + i * dx, y + i * dy), color);
+    }
+  }
+
+  Adafruit_NeoPixel &strip;
+  uint16_t first;
+};
+
+#endif // PIXEL_MATRIX_H
@@ -14,6 +14,13 @@
 
 #include "neopixel.h"
 
+#include "frameQueue.h"  //lock-free handoff to the render thread
+#include "effects.h"     //time-driven pixel effects
+#include "pixelMatrix.h" //xy drawing on the 8x8 panel
+#include "crossfade.h"   //smooth switch between patterns
+#include "clips.h"       //designed animations in flash, built by tools/makeClips.py
+#include "compositor.h"  //panel zones drawn by their own effects, committed together
+
 // Define parameters for OLED and create 'display' object
 #define OLED_RESET D4
 Adafruit_SSD1306 display(OLED_RESET);
@@ -21,16 +28,67 @@ Adafruit_SSD1306 display(OLED_RESET);
 // Define number of pixels and create 'pixel' object/'
 
 const int PIXELCOUNT = 64;
-Adafruit_NeoPixel pixel(PIXELCOUNT, SPI1, WS2812B);
+// the frame lives in retained memory so a warm reset (OTA update, crash) picks up where the panel left off
+// it is zero after power on, the spi encode buffers don't need to survive
+retained uint8_t pixelStorage[PIXELCOUNT * 3];
+uint8_t pixelSpiStorage[neoPixelSpiBufferSize(PIXELCOUNT, WS2812B)];
+Adafruit_NeoPixel pixel(PIXELCOUNT, SPI1, WS2812B, pixelStorage, pixelSpiStorage, false);
+PixelMatrix<8, 8, MatrixLayout::PROGRESSIVE> panel(pixel); // the same pixels as an 8x8 grid, for bars and arrows
+static_assert(panel.count == PIXELCOUNT, "panel size must match the strip");
 int pixelPattern = 0; // variable to track pixel sequences (0 = ambient colors, 1 = low traffic, 2 = heavy traffic, 3 = time to leave, 4 = late)
-int pixelColor = 0x0000FF; // variable to store color variable starting with default blue
 int pixelBrightness = 100; // variable for pixel brightness 0-255
+const uint16_t PIXEL_POWER_BUDGET_MA = 800; // pixel share of a 1A usb supply, the rest is for the P2 and OLED
 
 int myTimeZone = -7; // variable to adjust time zone from UTC
 
 unsigned int logicCallInterval = 60000; // default to calling logic every 60000 milliseconds
 unsigned int lastTime = -logicCallInterval; // used to track last time logic was called
-unsigned int lastShowTime = -60000; // variable to track last pixel update
+bool pixelsChanged = false; // true when the frame buffer differs from what is on the strip
+
+// once setup() is done the render thread owns 'pixel' and everything it draws,
+// loop() and handleResponse() only send it commands through renderQueue
+// the strip's show calls are not thread-safe, only the owning thread may call them
+struct RenderCommand
+{
+  int pattern;    // pixel sequence to run, same values as pixelPattern
+  int brightness; // pixel brightness 0-255
+  int delayMinutes;   // traffic delay for the traffic bar
+  int minutesToLeave; // minutes before the optimal departure, for the countdown bar
+};
+FrameQueue<RenderCommand, 8> renderQueue;
+Thread *renderThread;
+const system_tick_t RENDER_FRAME_MS = 20; // fixed frame clock for the render thread
+
+// hue band for each traffic pattern, on the 0-65535 color wheel
+const uint16_t HUE_RED = 0;
+const uint16_t HUE_ORANGE = 7100;
+const uint16_t HUE_GREEN = 21845;
+const uint16_t HUE_BLUE = 43690;
+const uint16_t HUE_SPREAD = 1500; // how far a pixel may drift either side of its band
+
+// one effect per traffic pattern, indexed by pixelPattern
+WipeEffect ambientEffect({0, 0x8000}, 222, true);                 // 0: each pass a new random color
+WipeEffect lowTrafficEffect({HUE_GREEN, HUE_SPREAD}, 222);        // 1: calm green wipe
+ClipEffect heavyTrafficEffect(rushHourWarning);                   // 2: flashing warning sign clip
+WipeEffect leaveNowEffect({HUE_ORANGE, HUE_SPREAD}, 222);         // 3: orange wipe, time to go
+WipeEffect lateEffect({HUE_BLUE, HUE_SPREAD}, 222);               // 4: blue wipe
+Effect *const patternEffects[] = {&ambientEffect, &lowTrafficEffect, &heavyTrafficEffect, &leaveNowEffect, &lateEffect};
+const int PATTERN_COUNT = sizeof(patternEffects) / sizeof(patternEffects[0]);
+Crossfade<PIXELCOUNT> patternFade(pixel);  // blends the old pattern into the new one
+const uint16_t PATTERN_FADE_MS = 1500;     // how long a pattern change takes
+
+// the panel split into zones, each drawn by its own effect at its own frame rate
+// progressive wiring keeps every row one contiguous range of the strip
+const uint8_t PATTERN_ROWS = 6;            // rows 0-5: the traffic pattern effect, every frame
+const uint8_t TRAFFIC_BAR_ROW = 6;         // row 6: traffic delay, green to red
+const uint8_t COUNTDOWN_BAR_ROW = 7;       // row 7: time left before leaving, red to green
+const uint16_t BAR_FRAME_MS = 500;         // the bars only move when a webhook response arrives
+const int TRAFFIC_BAR_FULL_MINUTES = 40;   // delay that fills the traffic bar
+const int COUNTDOWN_BAR_FULL_MINUTES = 60; // minutes to leave that fill the countdown bar
+LevelEffect trafficBarEffect(HUE_GREEN, HUE_RED);
+LevelEffect countdownBarEffect(HUE_RED, HUE_GREEN);
+Compositor panelCompositor(pixel);
+int patternSegment = -1;
 
 
 // default paramaters for tomtom api call
@@ -57,7 +115,11 @@ SYSTEM_THREAD(ENABLED);
 // create prototypes of functions
 void handleResponse(const char *event, const char *data);
 
+void renderLoop(void *param);
 void lightPixels(int patternNumber);
+uint8_t barLevel(int value, int fullValue);
+void renderPixel(int pixelNumber, int color);
+void commitPixels();
 
 // setup() runs once, when the device is first turned on
 void setup()
@@ -77,15 +139,41 @@ void setup()
   // neopixel setup
   pixel.begin();
   pixel.setBrightness(pixelBrightness);
-  pixel.clear();
-  pixel.show();
+  pixel.setGamma(2.6);                      // perceptual fades on the matrix
+  pixel.setColorCorrection(0xFF, 0xB0, 0xF0); // ws2812 green and blue run hot
+  pixel.setPowerBudget(PIXEL_POWER_BUDGET_MA); // dim the whole panel rather than brown out the usb supply
+  pixel.setDithering(true);                    // smooth fades at low and nighttime brightness, needs a frame every tick
+  pixel.show(); // the retained frame from before a warm reset, black after power on
 
+  bool frameRetained = false;
   for (int i = 0; i < PIXELCOUNT; i++)
-  { // light up all pixels random colors on startup
-    pixel.setPixelColor(i, random(0x000000, 0xFFFFFF));
-    pixel.show();
+  {
+    if (pixel.getPixelColor(i) != 0)
+    {
+      frameRetained = true;
+    }
+  }
+  if (!frameRetained)
+  {
+    for (int i = 0; i < PIXELCOUNT; i++)
+    { // light up all pixels random colors on startup
+      renderPixel(i, Adafruit_NeoPixel::ColorHSV(random(0x10000)));
+    }
+    commitPixels();
   }
 
+  // panel zones, the pattern segment gets its effect on the first frame
+  patternSegment = panelCompositor.add(panel.index(0, 0), PATTERN_ROWS * panel.width, NULL);
+  panelCompositor.add(panel.index(0, TRAFFIC_BAR_ROW), panel.width, &trafficBarEffect, BAR_FRAME_MS);
+  panelCompositor.add(panel.index(0, COUNTDOWN_BAR_ROW), panel.width, &countdownBarEffect, BAR_FRAME_MS);
+  panelCompositor.start(millis());
+
+  // the strip belongs to one thread at a time: let the startup frame finish here before the render thread owns it
+  pixel.waitShow();
+
+  // hand the strip to the render thread, just above the application thread so cloud work in loop() can't stall a frame
+  renderThread = new Thread("render", renderLoop, NULL, OS_THREAD_PRIORITY_DEFAULT + 1, 2048);
+
   delay(1000);
 
   // time setup
@@ -99,8 +187,6 @@ void setup()
 
 void loop()
 {
-  lightPixels(pixelPattern);
-
   if (Particle.connected() && millis() - lastTime > logicCallInterval)
   {
     Serial.printf("\n\nLocal Time Now: %02i:%02i\n\n", Time.hour(), Time.minute()); // print current time
@@ -229,7 +315,10 @@ void handleResponse(const char *event, const char *data)
         }
       }
 
-      pixel.setBrightness(pixelBrightness); // set pixel brightness if received from logic
+      if (!renderQueue.push({pixelPattern, pixelBrightness, trafficDelayInSeconds / 60, minutesToLeave})) // send pattern, brightness and bar levels from logic to the render thread
+      {
+        Serial.printf("render queue full, pixel update dropped\n");
+      }
       display.clearDisplay(); //clear display for new data
       display.setCursor(0, 0);
       if (targetHour == -1) // no specified arrival time
@@ -252,82 +341,87 @@ void handleResponse(const char *event, const char *data)
   }
 }
 
-void lightPixels(int patternNumber)
+// render thread: applies commands from renderQueue and draws the current pattern once per frame
+void renderLoop(void *param)
 {
-  static int currentPixel = 0;
-  if (millis() - lastShowTime > 222)
+  int renderPattern = pixelPattern;
+  system_tick_t lastWake = millis();
+  while (true)
   {
-
-    //determine a random range of colors for each pattern
-
-    if (patternNumber == 0) // default ambient random pattern
+    RenderCommand command;
+    while (renderQueue.pop(command))
     {
-      pixel.setPixelColor(currentPixel, pixelColor);
-      pixel.show();
-      currentPixel++;
-      if (currentPixel > PIXELCOUNT)
+      renderPattern = command.pattern;
+      trafficBarEffect.setLevel(barLevel(command.delayMinutes, TRAFFIC_BAR_FULL_MINUTES));
+      countdownBarEffect.setLevel(barLevel(command.minutesToLeave, COUNTDOWN_BAR_FULL_MINUTES));
+      if (pixel.getBrightness() != command.brightness)
       {
-        currentPixel = 0;
-        pixelColor = random(0x000000, 0xFFFFFF); //all 16 million+ hex colors at random
+        pixel.setBrightness(command.brightness); // set pixel brightness if received from logic
+        pixelsChanged = true;                    // brightness is applied when the frame is encoded, so recommit it
       }
     }
 
-    if (patternNumber == 1) // low traffic
-    {
-      pixelColor = random(0x00FF00, 0x33FF33); //green range
-      for (int i = 0; i < PIXELCOUNT; i++)
-      {
-        pixel.setPixelColor(currentPixel, pixelColor);
-        pixel.show();
-      }
-      currentPixel++;
-      if (currentPixel > PIXELCOUNT)
-      {
-        currentPixel = 0;
-      }
-    }
-    if (patternNumber == 2) // heavy traffic
-    {
-      pixelColor = random(0xFF0000, 0xFF3333); //red range
-      for (int i = 0; i < PIXELCOUNT; i++)
-      {
-        pixel.setPixelColor(currentPixel, pixelColor); 
-        pixel.show();
-      }
-      currentPixel++;
-      if (currentPixel > PIXELCOUNT)
-      {
-        currentPixel = 0;
-      }
-    }
-    if (patternNumber == 3) // optimal departure window
-    {
-      pixelColor = random(0xFFA500, 0xFFB733); // orange 
-      for (int i = 0; i < PIXELCOUNT; i++)
-      {
-        pixel.setPixelColor(currentPixel, pixelColor);
-        pixel.show();
-      }
-      currentPixel++;
-      if (currentPixel > PIXELCOUNT)
-      {
-        currentPixel = 0;
-      }
-    }
-    if (patternNumber == 4) // beyond optimal departure window
-    {
-      pixelColor = random(0x0000FF, 0x3333FF); // blue range
-      for (int i = 0; i < PIXELCOUNT; i++)
-      {
-        pixel.setPixelColor(currentPixel, pixelColor);
-        pixel.show();
-      }
-      currentPixel++;
-      if (currentPixel > PIXELCOUNT)
-      {
-        currentPixel = 0;
-      }
-    }
-    lastShowTime = millis();
+    lightPixels(renderPattern);
+
+    os_thread_delay_until(&lastWake, RENDER_FRAME_MS); // sleep until the next frame, independent of how long this one took
+  }
+}
+
+// draw one frame of every panel zone that is due, the pattern zone runs the effect for 'patternNumber'
+// a new pattern restarts its effect from the first frame and fades in over the old one
+void lightPixels(int patternNumber)
+{
+  static int currentPattern = -1;
+  if (patternNumber < 0 || patternNumber >= PATTERN_COUNT)
+  {
+    patternNumber = 0; // unknown pattern, fall back to ambient
+  }
+
+  uint32_t now = millis();
+  if (patternNumber != currentPattern)
+  {
+    patternFade.start(now, PATTERN_FADE_MS); // fade from whatever is on the panel now
+    panelCompositor.setEffect(patternSegment, patternEffects[patternNumber], now);
+    currentPattern = patternNumber;
+  }
+  patternFade.beginFrame();
+  if (panelCompositor.render(now)) // only the zones that are due draw, all land in the one frame buffer
+  {
+    pixelsChanged = true;
   }
-}
\ No newline at end of file
+  if (patternFade.endFrame(now))
+  {
+    pixelsChanged = true;
+  }
+
+  commitPixels(); // push the finished frame to the strip (at most one show() per tick)
+}
+
+// scale 'value' to a bar level, 0 = empty at or below zero, 255 = full at 'fullValue' and above
+uint8_t barLevel(int value, int fullValue)
+{
+  return constrain(value, 0, fullValue) * 255 / fullValue;
+}
+
+// write one pixel into the frame buffer and remember if the frame changed
+void renderPixel(int pixelNumber, int color)
+{
+  uint32_t previousColor = pixel.getPixelColor(pixelNumber);
+  pixel.setPixelColor(pixelNumber, color);
+  if (pixel.getPixelColor(pixelNumber) != previousColor)
+  {
+    pixelsChanged = true;
+  }
+}
+
+// send the frame buffer to the strip only if something was rendered since the last commit
+// while dithering every frame is sent, the dither moves even when nothing was drawn
+// showAsync() returns as soon as the transfer starts, so loop() never waits on the strip
+void commitPixels()
+{
+  if (pixelsChanged || pixel.isDithering())
+  {
+    pixel.showAsync();
+    pixelsChanged = false;
+  }
+}
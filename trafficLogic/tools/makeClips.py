@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""
+Project trafficLogic
+Build the flash animation clips in src/clips.h from the sources in clips/
+
+    python3 tools/makeClips.py clips/*.clip -o src/clips.h
+
+A clip source is text, one keyword per line, frames drawn as ASCII art with
+one character per pixel and one line per row ('#' starts a comment):
+
+    name      rushHourWarning     C++ name of the clip
+    size      8 8                 width and height of a frame
+    frameMs   150                 how long each frame is shown
+    layout    progressive         or serpentine, how the strip runs through the panel
+    color     R ff2000            palette: a character and its RGB color
+    frame     3                   a frame shown for 3 frame times (default 1),
+    R......R                      followed by 'height' rows of 'width' characters
+    ...
+
+The byte format is documented in src/pixelClip.h.
+"""
+
+import argparse
+import sys
+
+
+class ClipError(Exception):
+    pass
+
+
+def parse_clip(path):
+    clip = {'name': None, 'width': None, 'height': None, 'frameMs': 100,
+            'layout': 'progressive', 'colors': {}, 'palette': [], 'frames': []}
+    with open(path) as source:
+        lines = [line.split('#', 1)[0].rstrip() for line in source]
+
+    row = 0
+    while row < len(lines):
+        words = lines[row].split()
+        row += 1
+        if not words:
+            continue
+        keyword, args = words[0], words[1:]
+        if keyword == 'name':
+            clip['name'] = args[0]
+        elif keyword == 'size':
+            clip['width'], clip['height'] = int(args[0]), int(args[1])
+        elif keyword == 'frameMs':
+            clip['frameMs'] = int(args[0])
+        elif keyword == 'layout':
+            if args[0] not in ('progressive', 'serpentine'):
+                raise ClipError('%s:%d: unknown layout %s' % (path, row, args[0]))
+            clip['layout'] = args[0]
+        elif keyword == 'color':
+            if len(args[0]) != 1:
+                raise ClipError('%s:%d: a color is named by one character' % (path, row))
+            clip['colors'][args[0]] = len(clip['palette'])
+            clip['palette'].append(int(args[1], 16))
+        elif keyword == 'frame':
+            if clip['width'] is None:
+                raise ClipError('%s:%d: size must come before the first frame' % (path, row))
+            repeat = int(args[0]) if args else 1
+            art = lines[row:row + clip['height']]
+            row += clip['height']
+            frame = []
+            for y, text in enumerate(art):
+                if len(text) != clip['width']:
+                    raise ClipError('%s:%d: row should be %d pixels' % (path, row - clip['height'] + y + 1, clip['width']))
+                try:
+                    indexes = [clip['colors'][c] for c in text]
+                except KeyError as e:
+                    raise ClipError('%s:%d: no color %s' % (path, row - clip['height'] + y + 1, e))
+                if clip['layout'] == 'serpentine' and y % 2:
+                    indexes.reverse()
+                frame.extend(indexes)
+            clip['frames'].extend([frame] * repeat)
+        else:
+            raise ClipError('%s:%d: unknown keyword %s' % (path, row, keyword))
+
+    if not clip['name'] or not clip['frames']:
+        raise ClipError('%s: a clip needs a name and at least one frame' % path)
+    if len(clip['palette']) > 256:
+        raise ClipError('%s: more than 256 colors' % path)
+    return clip
+
+
+def encode_frame(frame, previous):
+    """Runs for one frame: skip pixels that match 'previous', fill the rest."""
+    data = []
+    i = 0
+    while i < len(frame):
+        end = i + 1
+        if previous is not None and frame[i] == previous[i]:
+            while end < len(frame) and end - i < 128 and frame[end] == previous[end]:
+                end += 1
+            data.append(end - i - 1)
+        else:
+            while end < len(frame) and end - i < 128 and frame[end] == frame[i]:
+                end += 1
+            data.extend([0x80 + end - i - 1, frame[i]])
+        i = end
+    return data
+
+
+def encode_clip(clip):
+    data = []
+    previous = None  # frame 0 is always complete so playback can loop to it
+    for frame in clip['frames']:
+        data.extend(encode_frame(frame, previous))
+        previous = frame
+    return data
+
+
+def write_header(clips, sources, out):
+    out.write('/*\n'
+              ' * Project trafficLogic\n'
+              ' * Animation clips, generated by tools/makeClips.py from %s\n'
+              ' * Do not edit, change the sources and run the tool again\n'
+              ' */\n\n' % ', '.join(sources))
+    out.write('#ifndef CLIPS_H\n#define CLIPS_H\n\n#include "pixelClip.h"\n')
+    for clip in clips:
+        name = clip['name']
+        data = encode_clip(clip)
+        pixels = clip['width'] * clip['height']
+        out.write('\n// %s: %d frames of %d pixels, %d bytes (%d uncompressed)\n'
+                  % (name, len(clip['frames']), pixels, len(data), len(clip['frames']) * pixels * 3))
+        out.write('const uint32_t %sPalette[] = {%s};\n'
+                  % (name, ', '.join('0x%06X' % c for c in clip['palette'])))
+        out.write('const uint8_t %sData[] = {\n' % name)
+        for start in range(0, len(data), 16):
+            out.write('  %s,\n' % ', '.join('0x%02X' % b for b in data[start:start + 16]))
+        out.write('};\n')
+        out.write('const PixelClip %s = {%sPalette, %d, %d, %d, %d, %sData};\n'
+                  % (name, name, len(clip['palette']), pixels, len(clip['frames']), clip['frameMs'], name))
+    out.write('\n#endif // CLIPS_H\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Build flash animation clips for trafficLogic')
+    parser.add_argument('sources', nargs='+', help='.clip source files')
+    parser.add_argument('-o', '--output', help='header to write (default: stdout)')
+    args = parser.parse_args()
+
+    try:
+        clips = [parse_clip(path) for path in args.sources]
+    except (ClipError, ValueError, IndexError) as e:
+        sys.exit('makeClips: %s' % e)
+
+    if args.output:
+        with open(args.output, 'w') as out:
+            write_header(clips, args.sources, out)
+    else:
+        write_header(clips, args.sources, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()